@@ -7,19 +7,218 @@
 
 #include "Settings.h"
 
+// Command receive state, filled by the USART0 receive interrupt
+static char command[COMMAND_SIZE];
+static uint8_t commandIndex = 0;
+static uint8_t commandLength = 0;
+static uint8_t commandStarted = 0;
+static volatile uint8_t commandReady = 0; // A complete command waits in the buffer
+static RtcStamp commandEnd;               // Timestamp of the closing '>'
+
+/**
+ * @brief Writes a signed integer as decimal text.
+ * 
+ * @param out Where to write the text (not null terminated).
+ * @param value The value to write.
+ * @param width Minimum number of characters, padded on the left.
+ * @param pad The padding character (' ' or '0').
+ * @return char* Pointer just past the written text.
+ */
+char *formatNumber(char *out, int32_t value, uint8_t width, char pad) {
+	char digits[11];
+	uint8_t count = 0;
+	uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+	do {
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (value < 0) {
+		digits[count++] = '-';
+	}
+	while (width > count) {
+		*out++ = pad;
+		width--;
+	}
+	while (count > 0) {
+		*out++ = digits[--count];
+	}
+	return out;
+}
+
+/**
+ * @brief Reads a decimal integer with an optional sign.
+ * 
+ * @param text Pointer to the text position, advanced past the number.
+ * @param digits Maximum number of digits to read (0 for no limit).
+ * @return int32_t The value read (0 if there are no digits).
+ */
+int32_t parseNumber(const char **text, uint8_t digits) {
+	const char *p = *text;
+	int32_t value = 0;
+	bool negative = false;
+
+	if (*p == '-' || *p == '+') {
+		negative = (*p++ == '-');
+	}
+	for (uint8_t i = 0; *p >= '0' && *p <= '9' && (digits == 0 || i < digits); i++) {
+		value = value * 10 + (*p++ - '0');
+	}
+	*text = p;
+	return negative ? -value : value;
+}
+
+/**
+ * @brief Checks the location fields of a time set command.
+ * 
+ * @param timezone Timezone offset in hours (-12 to 14).
+ * @param latitude Latitude, -90 to 90 degrees.
+ * @param longitude Longitude, -180 to 180 degrees.
+ * @return uint8_t 1 if all fields are in range (a NaN from atof is not).
+ */
+static uint8_t validLocation(int32_t timezone, solar_angle_t latitude, solar_angle_t longitude)
+{
+	return timezone >= -12 && timezone <= 14
+		&& latitude >= SOLAR_ANGLE(-90.0) && latitude <= SOLAR_ANGLE(90.0)
+		&& longitude >= SOLAR_ANGLE(-180.0) && longitude <= SOLAR_ANGLE(180.0);
+}
+
+/**
+ * @brief Checks the date and time fields of a time set command or a query.
+ * 
+ * @param time The parsed fields.
+ * @return uint8_t 1 if the date exists and the time of day and the tick are in range.
+ */
+static uint8_t validDateTime(const SolarPositionParameters *time)
+{
+	if (time->month < 1 || time->month > 12) {
+		return 0;
+	}
+	uint8_t daysThisMonth = daysInMonth[time->month - 1];
+	if (time->month == 2 && isLeapYear(time->year)) {
+		daysThisMonth = 29;
+	}
+#ifdef CLOCK_MINIMAL
+	// The fixed point model counts days from 2000, its accuracy is stated up to 2099
+	if (time->year < 2000 || time->year > 2099) {
+		return 0;
+	}
+#endif
+	return time->day >= 1 && time->day <= daysThisMonth && time->hour <= 23 && time->minute <= 59
+		&& time->second <= 59 && time->hundreds < TICKS_PER_SECOND;
+}
+
+#ifdef CLOCK_MINIMAL
+
+/**
+ * @brief Writes an angle in 1/10000 of a degree as decimal degrees with 4 decimals (like "%3.4f").
+ * 
+ * @param out Where to write the text (not null terminated).
+ * @param value The angle.
+ * @return char* Pointer just past the written text.
+ */
+char *formatAngle(char *out, solar_angle_t value) {
+	if (value < 0) {
+		*out++ = '-';
+		value = -value;
+	}
+	out = formatNumber(out, value / 10000, 1, '0');
+	*out++ = '.';
+	return formatNumber(out, value % 10000, 4, '0');
+}
+
+/**
+ * @brief Reads decimal degrees (e.g. "-70.0206") as an angle in 1/10000 of a degree.
+ * 
+ * At most 3 integer digits are read and digits after the fourth decimal are skipped,
+ * which keeps the value in range and the output frame within FRAME_SIZE.
+ * 
+ * @param text Pointer to the text position, advanced past the number.
+ * @return solar_angle_t The angle read.
+ */
+solar_angle_t parseAngle(const char **text) {
+	const char *p = *text;
+	bool negative = (*p == '-');
+	int32_t value = parseNumber(&p, 3);
+
+	if (negative) {
+		value = -value;
+	}
+	value *= 10000;
+	if (*p == '.') {
+		p++;
+		int32_t scale = 1000;
+		for (; *p >= '0' && *p <= '9'; p++) {
+			value += (*p - '0') * scale;
+			scale /= 10;
+		}
+	}
+	*text = p;
+	return negative ? -value : value;
+}
+
 /**
- * @brief Executes a command by parsing it and updating global solar parameters.
+ * @brief Parses a time set command into a parameter structure.
+ * 
+ * Integer only variant of the command parser for the minimal build, same format as
+ * the full build: "YYYYMMDDHHMMSSX|TZ|LAT|LON", trailing fields are optional.
+ * 
+ * @param command A null terminated command string.
+ * @param time Receives the time and location, fields not in the command are taken from solar_params.
+ * @return uint8_t 1 if the command is valid, 0 if a field is out of range or malformed.
+ */
+uint8_t executeCommand(char *command, SolarPositionParameters *time)
+{
+	const char *p = command;
+	int32_t timezone = solar_params.timezone;
+
+	time->year = parseNumber(&p, 4);
+	time->month = parseNumber(&p, 2);
+	time->day = parseNumber(&p, 2);
+	time->hour = parseNumber(&p, 2);
+	time->minute = parseNumber(&p, 2);
+	time->second = parseNumber(&p, 2);
+	time->hundreds = parseNumber(&p, TICK_DIGITS);
+	time->latitude = solar_params.latitude;
+	time->longitude = solar_params.longitude;
+
+	// Skip to the second token
+	while (*p != '\0' && *p != '|') {
+		p++;
+	}
+	if (*p == '|') {
+		p++;
+		timezone = parseNumber(&p, 0);
+	}
+	if (*p == '|') {
+		p++;
+		time->latitude = parseAngle(&p);
+	}
+	if (*p == '|') {
+		p++;
+		time->longitude = parseAngle(&p);
+	}
+	time->timezone = timezone;
+	// Anything left over is a field that did not parse as a number
+	return *p == '\0' && validDateTime(time) && validLocation(timezone, time->latitude, time->longitude);
+}
+
+#else
+
+/**
+ * @brief Parses a time set command into a parameter structure.
  * 
  * This function processes a given command string, which is expected to contain
  * solar-related parameters in a specific format. It uses `strtok` to extract
- * tokens from the command string and then updates the global `solar_params` 
- * structure with the extracted values.
+ * tokens from the command string and stores the extracted values in `time`.
  * 
  * @param command A string containing the command to be executed. The command
  *                should be formatted with pipe ('|') characters separating
  *                the different parameters (e.g., "YYYYMMDDHHMMSSX|TZ|LAT|LON").
+ * @param time Receives the time and location, fields not in the command are taken from solar_params.
+ * @return uint8_t 1 if the command is valid, 0 if a field is out of range.
  */
-void executeCommand(char *command)
+uint8_t executeCommand(char *command, SolarPositionParameters *time)
 {
 	// Using strtok to extract tokens
 		// Split the first token into variables
@@ -30,59 +229,393 @@ void executeCommand(char *command)
 			minute = 0,
 			second = 0,
 			hundreds = 0;
+		int timezone = solar_params.timezone;
+		time->latitude = solar_params.latitude;
+		time->longitude = solar_params.longitude;
 		char *token = strtok(command, "|");
 		// Get the first token
-		sscanf(token, "%4u%2u%2u%2u%2u%2u%1u", &year, &month, &day, &hour, &minute, &second, &hundreds);
-		solar_params.year = year;
-		solar_params.month = month;
-		solar_params.day = day;
-		solar_params.hour = hour;
-		solar_params.minute = minute;
-		solar_params.second = second,
-		solar_params.hundreds = hundreds;
+		sscanf(token, "%4u%2u%2u%2u%2u%2u" TICK_SCAN, &year, &month, &day, &hour, &minute, &second, &hundreds);
+		time->year = year;
+		time->month = month;
+		time->day = day;
+		time->hour = hour;
+		time->minute = minute;
+		time->second = second;
+		time->hundreds = hundreds;
 		// Get the second token
 		token = strtok(NULL, "|");
 		if (token != NULL) {
-			solar_params.timezone = atoi(token); // Convert to int
+			timezone = atoi(token); // Convert to int
 		}
 		// Get the third token
 		token = strtok(NULL, "|");
 		if (token != NULL) {
-			solar_params.latitude = atof(token); // Convert to double
+			time->latitude = atof(token); // Convert to double
 		}
 		// Get the fourth token
 		token = strtok(NULL, "|");
 		if (token != NULL) {
-			solar_params.longitude = atof(token); // Convert to double
+			time->longitude = atof(token); // Convert to double
 		}
+		time->timezone = timezone;
+		return validDateTime(time) && validLocation(timezone, time->latitude, time->longitude);
+}
+
+#endif /* CLOCK_MINIMAL */
+
+/**
+ * @brief Returns the RTC counts a command spends on the wire.
+ * 
+ * @param length Length of the command without the '<' and '>' characters.
+ * @return int32_t Counts from the start bit of '<' to the stop bit of '>'.
+ */
+static int32_t wireCounts(uint8_t length) {
+	// 10 bits per character (start, 8 data, stop)
+	return (uint32_t)(length + 2) * 10 * (F_CPU / 32) / USART0_BAUD;
+}
+
+/**
+ * @brief Sets the clock to a parsed time set command.
+ * 
+ * The fields are copied and the RTC phase is aligned with interrupts disabled, so the
+ * RTC interrupt never sees a half written time or advances it before the alignment.
+ * 
+ * @param time Time and location from executeCommand().
+ */
+static void setClock(const SolarPositionParameters *time) {
+	uint8_t sreg = SREG;
+	cli();
+	solar_params.year = time->year;
+	solar_params.month = time->month;
+	solar_params.day = time->day;
+	solar_params.hour = time->hour;
+	solar_params.minute = time->minute;
+	solar_params.second = time->second;
+	solar_params.hundreds = time->hundreds;
+	solar_params.timezone = time->timezone;
+	solar_params.latitude = time->latitude;
+	solar_params.longitude = time->longitude;
+	RTC_align(&commandEnd, wireCounts(commandLength));
+	SREG = sreg;
 }
 
 /**
- * @brief Reads and processes a command from USART0, updating solar parameters.
+ * @brief Sends the local time of day of a timestamp as "SSSSS.UUUUUU" (seconds of the day, microseconds).
  * 
- * This function listens for a command from the USART0 port, starting to read
- * when the '<' character is encountered, and stops reading when the '>' character
- * is detected. It stores the incoming characters in a buffer and passes the command
- * to `executeCommand()` for further processing once the full command has been received.
+ * @param stamp The timestamp.
+ */
+static void sendTimeOfDay(const RtcStamp *stamp) {
+	char text[16];
+	uint32_t seconds, micros;
+
+	RTC_timeOfDay(stamp, &seconds, &micros);
+	char *end = formatNumber(text, seconds, 5, '0');
+	*end++ = '.';
+	end = formatNumber(end, micros, 6, '0');
+	*end = '\0';
+	USART0_sendString(text);
+}
+
+/**
+ * @brief Answers a sync request "S|T1" with "T|T1|T2|T3".
+ * 
+ * T1 is the host time the request was sent, it is echoed back unchanged. T2 is the
+ * device time the request started to arrive and T3 the device time the reply starts,
+ * so the host can calculate the offset and the link delay like NTP does.
+ * 
+ * @param hostStamp The T1 text of the request.
+ * @param length Length of the whole request, for the receive time compensation.
+ */
+static void syncReply(char *hostStamp, uint8_t length) {
+	RtcStamp received = commandEnd, sent;
+
+	Heartbeat_sync(1);
+
+	// Move T2 back to the start of the request, like T1 marks the start of sending at the host
+	int32_t count = (int32_t)received.count - wireCounts(length);
+	while (count < 0) {
+		count += RTC_TICK_COUNTS;
+		received.ticks--;
+	}
+	received.count = count;
+
+	USART0_frameHold(1);
+	RTC_stamp(&sent);
+	USART0_sendChar('<');
+	USART0_sendString("T|");
+	USART0_sendString(hostStamp);
+	USART0_sendChar('|');
+	sendTimeOfDay(&received);
+	USART0_sendChar('|');
+	sendTimeOfDay(&sent);
+	USART0_sendString(">\r\n");
+	USART0_frameHold(0);
+}
+
+/**
+ * @brief Applies the clock offset "O|MICROSECONDS" calculated by the host and answers "A|MICROSECONDS".
+ * 
+ * Offsets over one second are ignored, the host should send a time set command instead.
+ * 
+ * @param text The offset text of the command.
+ */
+static void syncOffset(const char *text) {
+	int32_t micros = parseNumber(&text, 0);
+	char reply[16];
+
+	if (micros > 1000000L || micros < -1000000L) {
+		linkStats.rx_invalid++;
+		return;
+	}
+
+	// 1 count = 1.6 us, rounded to the nearest count
+	RTC_adjust((micros * 5 + (micros < 0 ? -4 : 4)) / 8);
+	Heartbeat_sync(0);
+
+	// The frame waiting in the back slot may carry the old time
+	USART0_frameDiscard();
+	tickPending = 1;
+
+	char *end = formatNumber(reply, micros, 1, '0');
+	*end = '\0';
+	USART0_frameHold(1);
+	USART0_sendString("<A|");
+	USART0_sendString(reply);
+	USART0_sendString(">\r\n");
+	USART0_frameHold(0);
+}
+
+/**
+ * @brief Sends a separator and a number, for the statistics and query answers.
+ * 
+ * @param separator Character sent before the number.
+ * @param value The number.
+ */
+static void sendNumber(char separator, int32_t value) {
+	char text[12];
+	char *end = formatNumber(text, value, 1, '0');
+	*end = '\0';
+	USART0_sendChar(separator);
+	USART0_sendString(text);
+}
+
+/**
+ * @brief Answers "D|0" (or "D|1", which also resets the counters) with the link statistics.
+ * 
+ * The answer is "R|frames|missed|latency_min|latency_max|bin0,...,bin7|rx_dropped|rx_invalid|rx_errors".
+ * 
+ * @param reset 1 to clear the counters after taking the snapshot.
+ */
+static void statsReply(uint8_t reset) {
+	LinkStats stats;
+
+	// Take a consistent snapshot, the interrupts keep counting while it is sent
+	uint8_t sreg = SREG;
+	cli();
+	stats = linkStats;
+	if (reset) {
+		USART0_statsReset();
+	}
+	SREG = sreg;
+
+	USART0_frameHold(1);
+	USART0_sendString("<R");
+	sendNumber('|', stats.frames);
+	sendNumber('|', stats.missed);
+	sendNumber('|', stats.latency_min);
+	sendNumber('|', stats.latency_max);
+	for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+		sendNumber(i == 0 ? '|' : ',', stats.latency_histogram[i]);
+	}
+	sendNumber('|', stats.rx_dropped);
+	sendNumber('|', stats.rx_invalid);
+	sendNumber('|', stats.rx_errors);
+	USART0_sendString(">\r\n");
+	USART0_frameHold(0);
+}
+
+/**
+ * @brief Sends a separator and an angle in the frame format.
+ * 
+ * @param separator Character sent before the angle.
+ * @param angle The angle.
+ */
+static void sendAngle(char separator, solar_angle_t angle) {
+	char text[16];
+#ifdef CLOCK_MINIMAL
+	*formatAngle(text, angle) = '\0';
+#else
+	snprintf(text, sizeof(text), "%3.4f", angle);
+#endif
+	USART0_sendChar(separator);
+	USART0_sendString(text);
+}
+
+/**
+ * @brief Answers a solar position query "Q|YYYYMMDDhhmmsstt" or "Q|YYYYMMDDhhmmsstt|site"
+ *        with "P|YYYYMMDDhhmmsstt|site|azimuth|elevation|counts".
+ * 
+ * The time is local time in the timezone of the clock and tt the tick (TICK_DIGITS digits), like
+ * in a time set command. Site 0 is the location in solar_params. The position is calculated on a local copy of the parameters,
+ * the live clock is not touched. counts is the time from the end of the query to the start of
+ * the answer (RTC counts, 1.6 us), so the host can record the response latency. The answer
+ * goes out behind the frame on the wire, a tick that falls into it sends its frame right after.
+ * 
+ * @param text The arguments of the query.
+ */
+static void queryReply(char *text) {
+	SolarPositionParameters query;
+	const char *p = text;
+	int32_t site = 0;
+
+	query.year = parseNumber(&p, 4);
+	query.month = parseNumber(&p, 2);
+	query.day = parseNumber(&p, 2);
+	query.hour = parseNumber(&p, 2);
+	query.minute = parseNumber(&p, 2);
+	query.second = parseNumber(&p, 2);
+	query.hundreds = parseNumber(&p, TICK_DIGITS);
+	if (p != text + 14 + TICK_DIGITS || (*p != '\0' && *p != '|')) {
+		linkStats.rx_invalid++;
+		return;
+	}
+	if (*p == '|') {
+		p++;
+		site = parseNumber(&p, 0);
+		if (*p != '\0') {
+			linkStats.rx_invalid++;
+			return;
+		}
+	}
+	text[14 + TICK_DIGITS] = '\0'; // The answer repeats the time only
+
+#ifdef CLOCK_MINIMAL
+	if (site != 0 || !validDateTime(&query)) {
+#else
+	if (site < 0 || site >= SOLAR_SITE_COUNT || !validDateTime(&query)) {
+#endif
+		linkStats.rx_invalid++;
+		return;
+	}
+
+	query.timezone = solar_params.timezone;
+#ifdef CLOCK_MINIMAL
+	query.latitude = solar_params.latitude;
+	query.longitude = solar_params.longitude;
+#else
+	query.latitude = (site == 0) ? solar_params.latitude : solar_sites.latitude[site];
+	query.longitude = (site == 0) ? solar_params.longitude : solar_sites.longitude[site];
+#endif
+	calculate_solar_position_at(&query);
+
+	USART0_frameHold(1);
+	int32_t latency = RTC_elapsed(&commandEnd);
+	USART0_sendString("<P|");
+	USART0_sendString(text);
+	sendNumber('|', site);
+	sendAngle('|', query.azimuth);
+	sendAngle('|', query.elevation);
+	sendNumber('|', latency);
+	USART0_sendString(">\r\n");
+	USART0_frameHold(0);
+}
+
+/**
+ * @brief Processes a command received by the USART0 interrupt, if there is one.
+ * 
+ * Time set commands are applied only while the clock set input is held low. The RTC phase is
+ * aligned to the moment the command started to arrive, so the set time is exact to a few
+ * RTC counts instead of one tick. Sync, heartbeat ("L|mode"), statistics ("D|0") and solar position
+ * query ("Q|...") commands are handled at any time. A query waits until the frame of the current
+ * tick has been prepared. Commands that are not understood are counted in linkStats.rx_invalid.
  */
 void ClockAndDataSet(){
-	uint8_t  index = 0; // Module type: 1 for BLE receiver, 0 for standard RS485
-	char command[40] = {0}; // Actually ~35
-	uint8_t start = 0;
-	while(1){
-		char c = USART0_readChar();
-
-		if(start == 1){
-			if(c == '>'){
-				start = 0;
-				executeCommand(command);
-				index = 0;
-				break;
+	if (!commandReady) {
+		return;
+	}
+
+	if (command[0] == 'S' && command[1] == '|') {
+		syncReply(command + 2, commandLength);
+	}
+	else if (command[0] == 'O' && command[1] == '|') {
+		syncOffset(command + 2);
+	}
+	else if (command[0] == 'L' && command[1] == '|' && command[2] >= '0' && command[2] <= '0' + HEARTBEAT_SYNC) {
+		Heartbeat_setMode(command[2] - '0');
+	}
+	else if (command[0] == 'D' && command[1] == '|' && (command[2] == '0' || command[2] == '1')) {
+		statsReply(command[2] == '1');
+	}
+	else if (command[0] == 'Q' && command[1] == '|') {
+		// Let the frame of the current tick be prepared first, a query must not delay it
+		if (tickPending) {
+			return;
+		}
+		queryReply(command + 2);
+	}
+	else if (command[0] >= '0' && command[0] <= '9') {
+		if (!(SET_PORT.IN & SET_PIN_bm)) { // if time is changing from outside
+			SolarPositionParameters time;
+			if (executeCommand(command, &time)) {
+				setClock(&time);
+
+				// The frame waiting in the back slot carries the old time
+				USART0_frameDiscard();
+				tickPending = 1;
 			}
-			else
-				command[index++] = c;
+			else {
+				linkStats.rx_invalid++;
+			}
+		}
+	}
+	else if (command[0] == 'T' || command[0] == 'A' || command[0] == 'R' || command[0] == 'P') {
+		// Answer of this or another clock heard on a shared bus, not a command
+	}
+	else {
+		linkStats.rx_invalid++;
+	}
+	commandReady = 0;
+}
+
+/**
+ * @brief Interrupt handler for a received USART0 character. Collects one command between '<' and '>'.
+ * 
+ * The closing '>' is timestamped here, so the command can be processed later from the main loop
+ * without losing timing accuracy. Input is dropped until the previous command has been processed.
+ */
+ISR(USART0_RXC_vect) {
+	uint8_t status = USART0.RXDATAH; // Must be read before RXDATAL
+	char c = USART0.RXDATAL;
+
+	if (status & (USART_BUFOVF_bm | USART_FERR_bm | USART_PERR_bm)) {
+		linkStats.rx_errors++;
+		commandStarted = 0; // The command is damaged, drop it
+		return;
+	}
+	if (commandReady) {
+		if (c == '<') {
+			linkStats.rx_dropped++;
+		}
+		return;
+	}
+	if (c == '<') {
+		commandIndex = 0;
+		commandStarted = 1;
+	}
+	else if (commandStarted) {
+		if (c == '>') {
+			RTC_stamp(&commandEnd);
+			command[commandIndex] = '\0';
+			commandLength = commandIndex;
+			commandStarted = 0;
+			commandReady = 1;
+		}
+		else if (commandIndex < COMMAND_SIZE - 1) {
+			command[commandIndex++] = c;
+		}
+		else {
+			commandStarted = 0; // Too long, drop it
+			linkStats.rx_dropped++;
 		}
-		if(c == '<')
-			start = 1;
 	}
 }
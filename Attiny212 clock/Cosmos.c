@@ -35,6 +35,8 @@ bool is_daylight_saving_time(int year, int month, int day) {
     return false;
 }
 
+#ifndef CLOCK_MINIMAL
+
 /**
  * @brief Calculates the Julian Day Number (JDN) for a given date and time.
  * 
@@ -44,7 +46,7 @@ bool is_daylight_saving_time(int year, int month, int day) {
  * @param hour The hour of the day (24-hour format).
  * @param minute The minute of the hour.
  * @param second The second of the minute.
- * @param hundreds The hundreds of the second.
+ * @param hundreds The tick within the second (1/TICKS_PER_SECOND of a second).
  * @return The Julian Day Number.
  */
 double calculate_julian_day(int year, int month, int day, int hour, int minute, int second, int hundreds) {
@@ -57,7 +59,7 @@ double calculate_julian_day(int year, int month, int day, int hour, int minute,
 
     // Julian Day calculation
     double JD = floor(365.25 * (year + 4716)) + floor(30.6001 * (month + 1)) +
-    day + B - 1524.5 + (hour + minute / 60.0 + second / 3600.0 + hundreds / 36000) / 24;
+    day + B - 1524.5 + (hour + minute / 60.0 + second / 3600.0 + hundreds / (3600.0 * TICKS_PER_SECOND)) / 24;
     return JD;
 }
 
@@ -152,16 +154,17 @@ double calculate_atmospheric_refraction(double elevation, double solar_distance)
 }
 
 /**
- * @brief Calculates the solar position (elevation and azimuth) based on the given solar parameters.
+ * @brief Calculates the time dependent solar terms shared by every site.
  * 
- * @note This function uses several other functions to calculate the Julian Day, solar time, 
- * and solar declination, and applies atmospheric refraction corrections.
+ * @param params The date, time and timezone to calculate for (location fields are not used).
+ * @param eph Receives the declination, the clock time corrected by the equation of time
+ *            and timezone, and the solar distance.
  */
-void calculate_solar_position() {
-    int timezone_offset = solar_params.timezone + (is_daylight_saving_time(solar_params.year, solar_params.month, solar_params.day) ? 1 : 0);
+void calculate_solar_ephemeris(const volatile SolarPositionParameters *params, SolarEphemeris *eph) {
+    int timezone_offset = params->timezone + (is_daylight_saving_time(params->year, params->month, params->day) ? 1 : 0);
 
     // Calculate Julian Day
-    double JD = calculate_julian_day(solar_params.year, solar_params.month, solar_params.day, solar_params.hour - timezone_offset, solar_params.minute, solar_params.second, solar_params.hundreds);
+    double JD = calculate_julian_day(params->year, params->month, params->day, params->hour - timezone_offset, params->minute, params->second, params->hundreds);
     double JC = (JD - 2451545.0) / 36525.0;
 
     double M = calculate_solar_mean_anomaly(JC);
@@ -169,33 +172,49 @@ void calculate_solar_position() {
     double true_longitude = fmod(280.46646 + JC * (36000.76983 + JC * 0.0003032), 360.0) + (true_anomaly - M);
     double apparent_longitude = calculate_solar_apparent_longitude(true_longitude, JC);
     double obliquity = calculate_obliquity_of_ecliptic(JC);
-    double declination = calculate_solar_declination(apparent_longitude, obliquity);
+    double declination_rad = calculate_solar_declination(apparent_longitude, obliquity) * DEG_TO_RAD;
 
     double eq_time = 4.0 * (280.46646 + 36000.76983 * JC - apparent_longitude +
     (2.466 * sin(2 * DEG_TO_RAD * (280.46646 + 36000.76983 * JC))) - 
     (0.053 * sin(4 * DEG_TO_RAD * (280.46646 + 36000.76983 * JC))));
-    double solar_time = (solar_params.hour * 60 + solar_params.minute + (solar_params.second + solar_params.hundreds / 10.0) / 60.0 + eq_time + 4.0 * solar_params.longitude - 60.0 * timezone_offset) / 60.0;
 
-    double hour_angle = (solar_time - 12.0) * 15.0;
+    eph->sin_declination = sin(declination_rad);
+    eph->cos_declination = cos(declination_rad);
+    eph->clock_minutes = params->hour * 60 + params->minute + (params->second + (double)params->hundreds / TICKS_PER_SECOND) / 60.0 + eq_time - 60.0 * timezone_offset;
 
-    double latitude_rad = solar_params.latitude * DEG_TO_RAD;
-    double declination_rad = declination * DEG_TO_RAD;
-    double hour_angle_rad = hour_angle * DEG_TO_RAD;
+    // Calculate solar distance
+    eph->solar_distance = calculate_solar_distance(JC);
+}
+
+/**
+ * @brief Calculates the solar elevation and azimuth for one site from the shared solar terms.
+ * 
+ * @param eph The shared terms from calculate_solar_ephemeris().
+ * @param longitude Longitude of the site (in degrees).
+ * @param sin_latitude Sine of the site latitude.
+ * @param cos_latitude Cosine of the site latitude.
+ * @param elevation Receives the refraction corrected solar elevation (in degrees).
+ * @param azimuth Receives the solar azimuth (in degrees, 0-360).
+ */
+void calculate_site_position(const SolarEphemeris *eph, double longitude, double sin_latitude, double cos_latitude, double *elevation, double *azimuth) {
+    double solar_time = (eph->clock_minutes + 4.0 * longitude) / 60.0;
 
-    double sin_elevation = sin(latitude_rad) * sin(declination_rad) +
-    cos(latitude_rad) * cos(declination_rad) * cos(hour_angle_rad);
+    double hour_angle = (solar_time - 12.0) * 15.0;
+    double hour_angle_rad = hour_angle * DEG_TO_RAD;
 
-    solar_params.elevation = asin(sin_elevation) * RAD_TO_DEG;
+    double sin_elevation = sin_latitude * eph->sin_declination +
+    cos_latitude * eph->cos_declination * cos(hour_angle_rad);
 
-    // Calculate solar distance
-    double solar_distance = calculate_solar_distance(JC);
+    double elevation_deg = asin(sin_elevation) * RAD_TO_DEG;
 
     // Apply atmospheric refraction correction
-    solar_params.elevation += calculate_atmospheric_refraction(solar_params.elevation, solar_distance);
+    elevation_deg += calculate_atmospheric_refraction(elevation_deg, eph->solar_distance);
 
     // Calculate azimuth angle (normalized to [0, 360])
-    double sin_azimuth = (cos(declination_rad) * sin(hour_angle * DEG_TO_RAD)) / cos(solar_params.elevation * DEG_TO_RAD);
-    double cos_azimuth = (sin(declination_rad) - sin(latitude_rad) * sin(solar_params.elevation * DEG_TO_RAD)) / (cos(latitude_rad) * cos(solar_params.elevation * DEG_TO_RAD));
+    double sin_elevation_corrected = sin(elevation_deg * DEG_TO_RAD);
+    double cos_elevation_corrected = cos(elevation_deg * DEG_TO_RAD);
+    double sin_azimuth = (eph->cos_declination * sin(hour_angle_rad)) / cos_elevation_corrected;
+    double cos_azimuth = (eph->sin_declination - sin_latitude * sin_elevation_corrected) / (cos_latitude * cos_elevation_corrected);
 
     double azimuth_rad = atan2(sin_azimuth, cos_azimuth);
 
@@ -211,8 +230,77 @@ void calculate_solar_position() {
         azimuth_temp += 360.0; // Ensure positive angle
     }
     
-    solar_params.azimuth = azimuth_temp;
+    *elevation = elevation_deg;
+    *azimuth = azimuth_temp;
 }
 
+/**
+ * @brief Calculates the solar position (elevation and azimuth) for the date, time and location in the given parameters.
+ * 
+ * Works only on the given structure, so it is reentrant and can be used for any moment
+ * without touching the live clock in solar_params.
+ * 
+ * @param params Date, time, timezone and location; receives the elevation and azimuth.
+ */
+void calculate_solar_position_at(volatile SolarPositionParameters *params) {
+    SolarEphemeris eph;
+    double latitude_rad = params->latitude * DEG_TO_RAD;
+    double elevation, azimuth;
+
+    calculate_solar_ephemeris(params, &eph);
+    calculate_site_position(&eph, params->longitude, sin(latitude_rad), cos(latitude_rad), &elevation, &azimuth);
+    params->elevation = elevation;
+    params->azimuth = azimuth;
+}
 
+/**
+ * @brief Calculates the solar position (elevation and azimuth) based on the given solar parameters.
+ * 
+ * @note This function uses several other functions to calculate the Julian Day, solar time, 
+ * and solar declination, and applies atmospheric refraction corrections.
+ */
+void calculate_solar_position() {
+    calculate_solar_position_at(&solar_params);
+}
+
+/**
+ * @brief Precalculates the latitude terms of every configured site.
+ */
+void init_solar_sites() {
+    for (uint8_t i = 0; i < SOLAR_SITE_COUNT; i++) {
+        double latitude_rad = solar_sites.latitude[i] * DEG_TO_RAD;
+        solar_sites.sin_latitude[i] = sin(latitude_rad);
+        solar_sites.cos_latitude[i] = cos(latitude_rad);
+    }
+}
+
+/**
+ * @brief Calculates the solar position for every configured site at the current time.
+ * 
+ * The time dependent terms are calculated once, only the hour angle, elevation and azimuth
+ * are evaluated per site. Site 0 follows the location in `solar_params` and its result is
+ * also stored there.
+ */
+void calculate_sites_position() {
+    SolarEphemeris eph;
+
+    // Site 0 can be moved by a command, refresh its cached latitude terms when it changes
+    if (solar_sites.latitude[0] != solar_params.latitude) {
+        double latitude_rad = solar_params.latitude * DEG_TO_RAD;
+        solar_sites.latitude[0] = solar_params.latitude;
+        solar_sites.sin_latitude[0] = sin(latitude_rad);
+        solar_sites.cos_latitude[0] = cos(latitude_rad);
+    }
+    solar_sites.longitude[0] = solar_params.longitude;
+
+    calculate_solar_ephemeris(&solar_params, &eph);
+    for (uint8_t i = 0; i < SOLAR_SITE_COUNT; i++) {
+        calculate_site_position(&eph, solar_sites.longitude[i], solar_sites.sin_latitude[i], solar_sites.cos_latitude[i],
+                                &solar_sites.elevation[i], &solar_sites.azimuth[i]);
+    }
+
+    solar_params.elevation = solar_sites.elevation[0];
+    solar_params.azimuth = solar_sites.azimuth[0];
+}
 
+#endif /* CLOCK_MINIMAL */
@@ -13,6 +13,36 @@
 #define RAD_TO_DEG 57.295779513082320876798154814105 // 180 / pi
 #define FIXED_SHIFT 32
 
+#ifdef CLOCK_MINIMAL
+// Angles are stored in 1/10000 of a degree (4 digits after .), so no floating point support is linked
+typedef int32_t solar_angle_t;
+#define SOLAR_ANGLE(DEGREES) ((solar_angle_t)((DEGREES) * 10000.0 + ((DEGREES) < 0 ? -0.5 : 0.5)))
+#else
+// Angles are stored in degrees
+typedef double solar_angle_t;
+#define SOLAR_ANGLE(DEGREES) (DEGREES)
+#endif
+
+// Number of tracker sites driven by this clock (site 0 is the location in solar_params).
+// Can be set from the project symbols, together with the latitudes and longitudes of sites
+// 1 and up as comma separated lists, e.g. SOLAR_SITE_COUNT=3, SOLAR_SITE_LATITUDES=54.9,55.7
+// and SOLAR_SITE_LONGITUDES=23.9,21.1
+#ifndef SOLAR_SITE_COUNT
+#define SOLAR_SITE_COUNT 1
+#endif
+#ifndef SOLAR_SITE_LATITUDES
+#define SOLAR_SITE_LATITUDES
+#endif
+#ifndef SOLAR_SITE_LONGITUDES
+#define SOLAR_SITE_LONGITUDES
+#endif
+
+#if SOLAR_SITE_COUNT < 1
+#error "SOLAR_SITE_COUNT must be at least 1"
+#elif defined(CLOCK_MINIMAL) && SOLAR_SITE_COUNT != 1
+#error "The minimal build calculates site 0 only"
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Solar Position Parameters Structure
 ////////////////////////////////////////////////////////////////////////////////
@@ -26,8 +56,8 @@
  * calculated solar position (elevation and azimuth).
  */
 typedef struct {
-    double latitude;       /**< Latitude of the location (in degrees) */
-    double longitude;      /**< Longitude of the location (in degrees) */
+    solar_angle_t latitude;       /**< Latitude of the location (in degrees) */
+    solar_angle_t longitude;      /**< Longitude of the location (in degrees) */
 	int8_t timezone;		/**< Base timezone offset (adjust as needed for daylight savings or other time zones) */
   //  int16_t altitude;       /**< Altitude of the location (in meters) */ //moved to AVR64DD32 
     uint16_t year;        /**< Year of the date */
@@ -36,12 +66,48 @@ typedef struct {
     uint8_t hour;         /**< Hour of the day (0-23) */
     uint8_t minute;       /**< Minute of the hour (0-59) */
     uint8_t second;       /**< Second of the minute (0-59) */
-    uint8_t hundreds;	  /**< Hundreds of the second (0-9) */
-    double elevation;      /**< Solar elevation angle (in degrees) */
-    double azimuth;        /**< Solar azimuth angle (in degrees) */
+    uint8_t hundreds;	  /**< Tick within the second (0 to TICKS_PER_SECOND - 1) */
+    solar_angle_t elevation;      /**< Solar elevation angle (in degrees) */
+    solar_angle_t azimuth;        /**< Solar azimuth angle (in degrees) */
 } SolarPositionParameters;
 
 // Declare the global solar position parameters object, which will hold the current solar position data
 extern volatile SolarPositionParameters solar_params;
 
+#ifndef CLOCK_MINIMAL
+
+////////////////////////////////////////////////////////////////////////////////
+// Multi-site Structures
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Time dependent solar terms, shared by every site at one instant.
+ */
+typedef struct {
+    double sin_declination;  /**< Sine of the solar declination */
+    double cos_declination;  /**< Cosine of the solar declination */
+    double clock_minutes;    /**< Local clock time corrected by the equation of time and timezone (in minutes) */
+    double solar_distance;   /**< Earth-Sun distance (in AU) */
+} SolarEphemeris;
+
+/**
+ * @brief Table of tracker sites, stored as structure of arrays.
+ * 
+ * Latitude terms are precalculated by init_solar_sites(), so each tick only the
+ * hour angle, elevation and azimuth have to be evaluated per site.
+ */
+typedef struct {
+    double latitude[SOLAR_SITE_COUNT];      /**< Latitude of each site (in degrees) */
+    double longitude[SOLAR_SITE_COUNT];     /**< Longitude of each site (in degrees) */
+    double sin_latitude[SOLAR_SITE_COUNT];  /**< Cached sine of the latitude */
+    double cos_latitude[SOLAR_SITE_COUNT];  /**< Cached cosine of the latitude */
+    double elevation[SOLAR_SITE_COUNT];     /**< Solar elevation at each site (in degrees) */
+    double azimuth[SOLAR_SITE_COUNT];       /**< Solar azimuth at each site (in degrees) */
+} SolarSiteTable;
+
+// Declare the global site table, only used from the main loop
+extern SolarSiteTable solar_sites;
+
+#endif /* CLOCK_MINIMAL */
+
 #endif /* COSMOS_H_ */
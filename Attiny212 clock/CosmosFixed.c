@@ -0,0 +1,268 @@
+/*
+ * CosmosFixed.c
+ *
+ * Fixed point solar position model of the minimal build.
+ */
+
+#include "Settings.h"
+
+#ifdef CLOCK_MINIMAL
+
+// Fixed point formats used below:
+// angles are in 1/10000 of a degree (same as solar_angle_t), sine/cosine values are Q14 (16384 = 1.0)
+#define Q14_ONE 16384
+#define ANGLE_90 900000L
+#define ANGLE_180 1800000L
+#define ANGLE_360 3600000L
+
+// CORDIC gain compensation (0.607253 in Q14)
+#define CORDIC_GAIN 9949
+#define CORDIC_STEPS 16
+
+// atan(2^-i) in 1/10000 of a degree
+static const int32_t cordic_atan[CORDIC_STEPS] = {
+    450000, 265651, 140362, 71250, 35763, 17899, 8952, 4476, 2238, 1119, 560, 280, 140, 70, 35, 17
+};
+
+// Low precision solar coordinates (Astronomical Almanac), angles in 1/10000 of a degree
+#define MEAN_LONGITUDE_J2000 2804600L   // 280.460 degrees
+#define MEAN_ANOMALY_J2000 3575280L     // 357.528 degrees
+#define DAILY_MOTION 9856L              // 0.9856 degrees per day, common part of both rates
+#define LONGITUDE_RATE_REST 474L        // + 0.0000474 degrees per day for the mean longitude
+#define ANOMALY_RATE_REST 3L            // + 0.0000003 degrees per day for the mean anomaly
+#define EQUATION_OF_CENTER_1 19150L     // 1.915 degrees
+#define EQUATION_OF_CENTER_2 200L       // 0.020 degrees
+#define OBLIQUITY_J2000 234390L         // 23.439 degrees, decreasing 0.0000004 degrees per day
+
+/**
+ * @brief Multiplies a value by a Q14 factor without needing a 64-bit product.
+ *
+ * @param value The value to scale.
+ * @param factor The Q14 factor (-1.0 to 1.0).
+ * @return The scaled value.
+ */
+static int32_t mul_q14(int32_t value, int16_t factor) {
+    return (value >> 14) * factor + (((value & 0x3FFF) * factor) >> 14);
+}
+
+/**
+ * @brief Wraps an angle into the range -180 to 180 degrees.
+ *
+ * @param angle The angle in 1/10000 of a degree.
+ * @return The wrapped angle.
+ */
+static int32_t wrap_angle(int32_t angle) {
+    angle %= ANGLE_360;
+    if (angle > ANGLE_180) {
+        angle -= ANGLE_360;
+    } else if (angle <= -ANGLE_180) {
+        angle += ANGLE_360;
+    }
+    return angle;
+}
+
+/**
+ * @brief Calculates sine and cosine of an angle with CORDIC rotation.
+ *
+ * @param angle The angle in 1/10000 of a degree.
+ * @param cosine Receives the cosine (Q14).
+ * @param sine Receives the sine (Q14).
+ */
+static void cordic_sincos(int32_t angle, int16_t *cosine, int16_t *sine) {
+    int32_t x = CORDIC_GAIN, y = 0;
+    int8_t sign = 1;
+
+    // CORDIC converges for +-90 degrees, fold the rest onto it
+    angle = wrap_angle(angle);
+    if (angle > ANGLE_90) {
+        angle = ANGLE_180 - angle;
+        sign = -1;
+    } else if (angle < -ANGLE_90) {
+        angle = -ANGLE_180 - angle;
+        sign = -1;
+    }
+
+    for (uint8_t i = 0; i < CORDIC_STEPS; i++) {
+        int32_t dx = y >> i, dy = x >> i;
+        if (angle >= 0) {
+            x -= dx;
+            y += dy;
+            angle -= cordic_atan[i];
+        } else {
+            x += dx;
+            y -= dy;
+            angle += cordic_atan[i];
+        }
+    }
+    *cosine = sign * x;
+    *sine = y;
+}
+
+/**
+ * @brief Calculates atan2(y, x) with CORDIC vectoring.
+ *
+ * @param y The y component (any scale, |y| and |x| below 2^29).
+ * @param x The x component (same scale as y).
+ * @param magnitude Receives sqrt(x^2 + y^2) in the same scale (may be NULL).
+ * @return The angle in 1/10000 of a degree (-180 to 180).
+ */
+static int32_t cordic_atan2(int32_t y, int32_t x, int32_t *magnitude) {
+    int32_t angle = 0;
+
+    // Rotate the left half plane by 180 degrees
+    if (x < 0) {
+        x = -x;
+        y = -y;
+        angle = ANGLE_180;
+    }
+
+    for (uint8_t i = 0; i < CORDIC_STEPS; i++) {
+        int32_t dx = y >> i, dy = x >> i;
+        if (y > 0) {
+            x += dx;
+            y -= dy;
+            angle += cordic_atan[i];
+        } else {
+            x -= dx;
+            y += dy;
+            angle -= cordic_atan[i];
+        }
+    }
+    if (magnitude != NULL) {
+        *magnitude = mul_q14(x, CORDIC_GAIN);
+    }
+    return wrap_angle(angle);
+}
+
+/**
+ * @brief Calculates the integer square root.
+ *
+ * @param value The value.
+ * @return The largest integer whose square does not exceed the value.
+ */
+static uint16_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/**
+ * @brief Calculates a Q14 cosine from a Q14 sine of an angle within +-90 degrees.
+ *
+ * @param sine The sine (Q14).
+ * @return The cosine (Q14).
+ */
+static int16_t cos_from_sin(int32_t sine) {
+    if (sine > Q14_ONE) {
+        sine = Q14_ONE;
+    } else if (sine < -Q14_ONE) {
+        sine = -Q14_ONE;
+    }
+    return isqrt((uint32_t)Q14_ONE * Q14_ONE - sine * sine);
+}
+
+/**
+ * @brief Calculates the solar position (elevation and azimuth) in fixed point.
+ *
+ * Low precision model for the minimal build: the Astronomical Almanac solar coordinates
+ * (about 0.01 degrees for 1950-2050) with CORDIC trigonometry, so neither libm nor
+ * floating point support is linked. Stays within about 0.2 degrees of the full model
+ * above the horizon. Valid for years 2000 to 2099, which validDateTime() enforces; after
+ * about 2588 days * DAILY_MOTION no longer fits in 32 bits. Works only on the given structure,
+ * so it is reentrant and can be used for any moment without touching the live clock in solar_params.
+ *
+ * @param params Date, time, timezone and location; receives the elevation and azimuth.
+ */
+void calculate_solar_position_at(volatile SolarPositionParameters *params) {
+    int8_t timezone_offset = params->timezone + (is_daylight_saving_time(params->year, params->month, params->day) ? 1 : 0);
+
+    // Whole days since 2000-01-01
+    uint16_t last_year = params->year - 1;
+    int32_t days = 365L * (params->year - 2000) + last_year / 4 - last_year / 100 + last_year / 400 - 484;
+    for (uint8_t m = 1; m < params->month; m++) {
+        days += daysInMonth[m - 1];
+    }
+    if (params->month > 2 && isLeapYear(params->year)) {
+        days++;
+    }
+    days += params->day - 1;
+
+    // Local time shifted to UTC and measured from noon (may leave the day, the angles do not mind)
+    int32_t noon_seconds = params->hour * 3600L + params->minute * 60 + params->second - timezone_offset * 3600L - 43200L;
+    int32_t day_fraction_motion = noon_seconds * DAILY_MOTION / 86400;
+
+    // Mean longitude and mean anomaly, days counted from J2000.0 (2000-01-01 12:00 UTC)
+    int32_t mean_longitude = wrap_angle(MEAN_LONGITUDE_J2000 + wrap_angle(days * DAILY_MOTION) + days * LONGITUDE_RATE_REST / 1000 + day_fraction_motion);
+    int32_t mean_anomaly = wrap_angle(MEAN_ANOMALY_J2000 + wrap_angle(days * DAILY_MOTION) + days * ANOMALY_RATE_REST / 1000 + day_fraction_motion);
+
+    // Ecliptic longitude
+    int16_t c, s;
+    int32_t ecliptic_longitude = mean_longitude;
+    cordic_sincos(mean_anomaly, &c, &s);
+    ecliptic_longitude += mul_q14(EQUATION_OF_CENTER_1, s);
+    cordic_sincos(2 * mean_anomaly, &c, &s);
+    ecliptic_longitude += mul_q14(EQUATION_OF_CENTER_2, s);
+
+    int16_t cos_obl, sin_obl, cos_lon, sin_lon;
+    cordic_sincos(OBLIQUITY_J2000 - days * 4 / 1000, &cos_obl, &sin_obl);
+    cordic_sincos(ecliptic_longitude, &cos_lon, &sin_lon);
+
+    // Declination and right ascension, the equation of time is mean longitude - right ascension
+    int16_t sin_dec = mul_q14(sin_obl, sin_lon);
+    int16_t cos_dec = cos_from_sin(sin_dec);
+    int32_t right_ascension = cordic_atan2((int32_t)cos_obl * sin_lon, (int32_t)cos_lon << 14, NULL);
+
+    // Hour angle: 1 second of time = 125/3 units, longitude adds directly
+    int32_t hour_angle = noon_seconds * 125 / 3
+                       + params->hundreds * 125L / (3 * TICKS_PER_SECOND)
+                       + wrap_angle(mean_longitude - right_ascension)
+                       + params->longitude;
+
+    int16_t cos_lat, sin_lat, cos_ha, sin_ha;
+    cordic_sincos(params->latitude, &cos_lat, &sin_lat);
+    cordic_sincos(hour_angle, &cos_ha, &sin_ha);
+
+    // Local horizon frame (Q28): up is sin(elevation), east and north are the horizontal components
+    int32_t up = (int32_t)sin_lat * sin_dec + mul_q14((int32_t)cos_lat * cos_dec, cos_ha);
+    int32_t east = (int32_t)sin_ha * cos_dec;
+    int32_t north = mul_q14((int32_t)cos_ha * cos_dec, sin_lat) - (int32_t)sin_dec * cos_lat;
+
+    // Azimuth from north (the vector points away from the sun, hence + 180), the magnitude is cos(elevation)
+    int32_t horizontal;
+    int32_t azimuth = cordic_atan2(east, north, &horizontal) + ANGLE_180;
+    if (azimuth >= ANGLE_360) {
+        azimuth -= ANGLE_360;
+    }
+    int32_t elevation = cordic_atan2(up, horizontal, NULL);
+
+    // Atmospheric refraction, 0.0167 / tan(e + 10.3 / (e + 5.11)) degrees above -1 degree
+    if (elevation > -10000) {
+        cordic_sincos(elevation + 1030000000L / (elevation + 51100), &c, &s);
+        elevation += 167L * c / s;
+    }
+
+    params->elevation = elevation;
+    params->azimuth = azimuth;
+}
+
+/**
+ * @brief Calculates the solar position for the live clock in solar_params.
+ */
+void calculate_solar_position() {
+    calculate_solar_position_at(&solar_params);
+}
+
+#endif /* CLOCK_MINIMAL */
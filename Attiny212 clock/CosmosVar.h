@@ -10,8 +10,8 @@
 
 // Declare and initialize the solar position parameters for the specified location and time
 volatile SolarPositionParameters solar_params = {
-	.latitude = -70.0206,        /**< Latitude of the location (in degrees) */ //4 digits after . means: +-110m
-	.longitude = 162.6651,       /**< Longitude of the location (in degrees) */
+	.latitude = SOLAR_ANGLE(-70.0206),        /**< Latitude of the location (in degrees) */ //4 digits after . means: +-110m
+	.longitude = SOLAR_ANGLE(162.6651),       /**< Longitude of the location (in degrees) */
 	.timezone = -11,				/**< Base timezone offset (adjust as needed for daylight savings or other time zones) */
 	//.altitude = 85,             /**< Altitude of the location (in meters) */ //moved to AVR64DD32
 	.year = 2024,                 /**< Year of the date */
@@ -23,10 +23,30 @@ volatile SolarPositionParameters solar_params = {
 	.hundreds = 0,				  /**< Hundreds (0th hundreds) */
 	
 	// Pre-calculated solar elevation and azimuth for the given location and time
-	.elevation = 37.3,            /**< Average annual elevation for the selected coordinates (in degrees) */
+	.elevation = SOLAR_ANGLE(37.3),            /**< Average annual elevation for the selected coordinates (in degrees) */
 	
 	// Azimuth is calculated from South (180) with an offset towards the East
-	.azimuth = 171.4              /**< Azimuth direction (180 = South, 171.4 is 8.6 East of South) */
+	.azimuth = SOLAR_ANGLE(171.4)              /**< Azimuth direction (180 = South, 171.4 is 8.6 East of South) */
 };
 
+#ifndef CLOCK_MINIMAL
+// Tracker sites driven by this clock, sites 1 and up come from SOLAR_SITE_LATITUDES and SOLAR_SITE_LONGITUDES (Cosmos.h)
+SolarSiteTable solar_sites = {
+	.latitude = {
+		0.0,                      /**< Site 0 follows solar_params.latitude */
+		SOLAR_SITE_LATITUDES
+	},
+	.longitude = {
+		0.0,                      /**< Site 0 follows solar_params.longitude */
+		SOLAR_SITE_LONGITUDES
+	}
+};
+
+// Both lists must hold SOLAR_SITE_COUNT - 1 values, a short list would leave sites at 0, 0
+_Static_assert(sizeof((double[]){ 0.0, SOLAR_SITE_LATITUDES }) == SOLAR_SITE_COUNT * sizeof(double),
+	"SOLAR_SITE_LATITUDES must list SOLAR_SITE_COUNT - 1 latitudes");
+_Static_assert(sizeof((double[]){ 0.0, SOLAR_SITE_LONGITUDES }) == SOLAR_SITE_COUNT * sizeof(double),
+	"SOLAR_SITE_LONGITUDES must list SOLAR_SITE_COUNT - 1 longitudes");
+#endif /* CLOCK_MINIMAL */
+
 #endif /* COSMOSVAR_H_ */
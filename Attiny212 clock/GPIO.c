@@ -30,18 +30,21 @@ void GPIO_init() {
     // Wait until the external oscillator is stable after the change
     while (CLKCTRL.MCLKSTATUS & CLKCTRL_SOSC_bm);
 
-    // Set PORTA pin 5 as an output for USART TX LED
-    PORTA.DIRSET = PIN5_bm;
+    // Set the LED pin as an output for the heartbeat pulses (LED_PORT/LED_PIN_bm in Settings.h:
+    // PA5 driven by TCB0, PA2 driven by EVOUT0 in the minimal build)
+    LED_PORT.DIRSET = LED_PIN_bm;
 
-    // Set PORTB pin 2 as output (USART0: TX)
-    PORTB.DIRSET =  PIN2_bm;
+    // Set the USART0 TX pin as output (USART0_TX_bm: PB2, PA6 in the minimal build)
+    USART0_PORT.DIRSET = USART0_TX_bm;
 
-    // Set PORTB pin 3 as input (Clock set, USART0: RX)
-    PORTB.DIRCLR = PIN1_bm | PIN3_bm;
+    // Set the clock set and USART0 RX pins as inputs (SET_PIN_bm and USART0_RX_bm: PB1 and PB3,
+    // PA1 and PA7 in the minimal build)
+    SET_PORT.DIRCLR = SET_PIN_bm;
+    USART0_PORT.DIRCLR = USART0_RX_bm;
 
-    // Enable pull-up resistor for TX (PORTB pin 2)
-    PORTB.PIN2CTRL = PORT_PULLUPEN_bm;
+    // Enable pull-up resistor for TX (USART0_TX_PINCTRL)
+    USART0_TX_PINCTRL = PORT_PULLUPEN_bm;
 
-    // Enable pull-up resistor for RX (PORTB pin 3)
-    PORTB.PIN3CTRL = PORT_PULLUPEN_bm;
+    // Enable pull-up resistor for RX (USART0_RX_PINCTRL)
+    USART0_RX_PINCTRL = PORT_PULLUPEN_bm;
 }
\ No newline at end of file
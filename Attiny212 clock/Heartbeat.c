@@ -0,0 +1,109 @@
+/*
+ * Heartbeat.c
+ *
+ * Heartbeat LED and tick output, driven by the RTC overflow event.
+ */
+#include "Settings.h"
+
+// Pulse lengths in CLK_TCA periods (F_CPU / 1024 = 19531 Hz)
+#define PULSE_TICK ((F_CPU / 1024) / TICKS_PER_SECOND / 2) // Half a tick (25 ms at 20 Hz)
+#define PULSE_SECOND ((F_CPU / 1024) / 10)                  // 100 ms
+
+// Ticks a sync exchange may take before the HEARTBEAT_SYNC pulses stop on their own
+#define SYNC_TIMEOUT_TICKS TICKS_PER_SECOND
+
+static volatile uint8_t heartbeatMode = HEARTBEAT_TICK;
+static volatile uint8_t syncTicks = 0;
+
+/**
+ * @brief Sets up the hardware heartbeat: RTC overflow event -> EVSYS -> TCB0 single-shot pulse on the LED pin.
+ * 
+ * The pulse starts on the RTC overflow itself, without waiting for the interrupt, so its
+ * rising edge marks the start of a tick to within a few clock cycles. In the tick mode the
+ * CPU is not involved at all.
+ */
+void Heartbeat_init() {
+	// TCA0 provides the prescaled clock (CLK_TCA) for TCB0, so it is not free to count events
+	TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV1024_gc | TCA_SINGLE_ENABLE_bm;
+
+	// RTC overflow -> asynchronous channel 0 -> TCB0 event input
+	EVSYS.ASYNCCH0 = EVSYS_ASYNCCH0_RTC_OVF_gc;
+	EVSYS.ASYNCUSER0 = EVSYS_ASYNCUSER0_ASYNCCH0_gc;
+
+	// Single-shot: the output goes high on the event and low again after CCMP counts
+	TCB0.CCMP = PULSE_TICK;
+#ifdef LED_EVOUT
+	TCB0.CTRLB = TCB_CNTMODE_SINGLE_gc; // The TCB0 pin is USART0 TX, keep the output internal
+#else
+	TCB0.CTRLB = TCB_CNTMODE_SINGLE_gc | TCB_CCMPEN_bm; // TCB0 output is the LED pin (PA5)
+#endif
+	TCB0.CTRLA = TCB_CLKSEL_CLKTCA_gc | TCB_ENABLE_bm;
+	TCB0.EVCTRL = TCB_CAPTEI_bm;
+
+#if defined(LED_EVOUT) || defined(PPS_OUT)
+	// CCL LUT0 repeats the TCB0 output (truth table: output = input 0)
+	CCL.LUT0CTRLB = CCL_INSEL0_TCB0_gc;
+	CCL.TRUTH0 = 0xAA;
+#ifdef PPS_OUT
+	CCL.LUT0CTRLA = CCL_OUTEN_bm | CCL_ENABLE_bm; // LUT0 output pin (PA4)
+	PORTA.DIRSET = PIN4_bm;
+#else
+	CCL.LUT0CTRLA = CCL_ENABLE_bm;
+#endif
+	CCL.CTRLA = CCL_ENABLE_bm;
+#endif
+
+#ifdef LED_EVOUT
+	// LUT0 output -> asynchronous channel 1 -> EVOUT0 (PA2)
+	EVSYS.ASYNCCH1 = EVSYS_ASYNCCH1_CCL_LUT0_gc;
+	EVSYS.ASYNCUSER8 = EVSYS_ASYNCUSER0_ASYNCCH1_gc; // The channel values are defined for user 0 only, they apply to every user
+	PORTMUX.CTRLA |= PORTMUX_EVOUT0_bm;
+#endif
+}
+
+/**
+ * @brief Selects the heartbeat mode.
+ * 
+ * @param mode One of the HEARTBEAT_ modes.
+ */
+void Heartbeat_setMode(uint8_t mode) {
+	uint8_t sreg = SREG;
+	cli();
+	heartbeatMode = mode;
+	TCB0.CCMP = (mode == HEARTBEAT_SECOND) ? PULSE_SECOND : PULSE_TICK;
+
+	// Tick pulses need no arming, the other modes are armed tick by tick
+	TCB0.EVCTRL = (mode == HEARTBEAT_TICK) ? TCB_CAPTEI_bm : 0;
+	Heartbeat_tick();
+	SREG = sreg;
+}
+
+/**
+ * @brief Marks the start (1) or the end (0) of a sync exchange, for HEARTBEAT_SYNC.
+ * 
+ * @param active 1 when a sync request has arrived, 0 when the correction was applied.
+ */
+void Heartbeat_sync(uint8_t active) {
+	syncTicks = active ? SYNC_TIMEOUT_TICKS : 0;
+}
+
+/**
+ * @brief Arms or disarms the pulse for the next tick. Called by the RTC interrupt after the clock advanced.
+ * 
+ * Only the event input is switched here, the pulse itself is still started by the hardware.
+ */
+void Heartbeat_tick() {
+	if (heartbeatMode == HEARTBEAT_SECOND) {
+		// Arm only for the overflow that starts the next second
+		TCB0.EVCTRL = (solar_params.hundreds == TICKS_PER_SECOND - 1) ? TCB_CAPTEI_bm : 0;
+	}
+	else if (heartbeatMode == HEARTBEAT_SYNC) {
+		if (syncTicks > 0) {
+			syncTicks--;
+			TCB0.EVCTRL = TCB_CAPTEI_bm;
+		}
+		else {
+			TCB0.EVCTRL = 0;
+		}
+	}
+}
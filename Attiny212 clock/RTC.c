@@ -9,6 +9,12 @@
 // Number of days in each month (Non-leap year)
 const uint8_t daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
+// Start with a pending tick so the first frame is ready before the first overflow
+volatile uint8_t tickPending = 1;
+
+// Free running tick counter, never set, used as timebase for timestamps
+volatile uint32_t tickCount = 0;
+
 /**
  * @brief Checks whether a given year is a leap year.
  * 
@@ -27,88 +33,335 @@ void RTC_init() {
     RTC.CLKSEL = RTC_CLKSEL_EXTCLK_gc; // Select external clock
     RTC.CTRLA = RTC_RTCEN_bm | RTC_PRESCALER_DIV32_gc; // Enable RTC and set prescaler to 32
     RTC.INTCTRL = 0 << RTC_CMP_bp | 1 << RTC_OVF_bp; // Enable overflow interrupt
-    RTC.PER = 31250/*62466*/; // Set RTC period for 1-second overflow (20Mhz / 32 prescaler = 62500Hz, period = 625000/10 = 0.1sec)
+    RTC.PER = RTC_TICK_COUNTS - 1/*62466*/; // Set RTC period for one tick (20Mhz / 32 prescaler = 625000Hz, 625000/20 counts = 0.05sec, the counter wraps after PER)
 
 }
 
 /**
- * @brief Interrupt handler for RTC overflow. Updates the time and calculates solar position.
+ * @brief Computes the solar position for the upcoming tick and formats it into the back frame slot.
+ * 
+ * The RTC interrupt only swaps the frame slots and advances the time, so the calculation
+ * and formatting for tick N+1 overlap with tick N being transmitted by the USART interrupt.
  */
-ISR(RTC_CNT_vect) {
-    RTC.INTFLAGS = RTC_OVF_bm; // Clear the overflow interrupt flag
-    
-	if(PORTB.IN & PIN1_bm){ //If time is not changat from outside
-		
-		//PORTA.OUTSET = PIN5_bm;// toggling PIN5 otherwise to see led illumination will be not possible
-		PORTA.OUTTGL = PIN5_bm;// toggling PIN5 otherwise to see led illumination will be not possible
-		    
-		// Calculate solar position (can be customized to update your solar data)
-		calculate_solar_position();
-		printf("<%4d%02d%02d%02d%02d%02d%1d|%3.4f|%3.4f|%3.4f|%3.4f|%2d>\r\n",
-			   solar_params.year, 
-			   solar_params.month, 
-			   solar_params.day, 
-			   solar_params.hour, 
-			   solar_params.minute, 
-			   solar_params.second, 
-			   solar_params.hundreds, 
-			   solar_params.azimuth, 
-			   solar_params.elevation,
-			   solar_params.latitude, //55.19419 * 10 = 551.9419
-			   solar_params.longitude,
-			   solar_params.timezone/*,
-			   solar_params.altitude*/ //moved to AVR64DD32
-			   );
-    
-		// Increment milliseconds and handle time overflow
-		solar_params.hundreds++;
-		if (solar_params.hundreds >= 20) {
-			solar_params.hundreds = 0;
-			solar_params.second++;
+void RTC_prepareFrame() {
+	if (!tickPending) {
+		return;
+	}
+#if FRAME_SLOTS == 1
+	// The only slot is on the wire right after the tick, wait until it is free again
+	if (USART0_frameSending()) {
+		return;
+	}
+#endif
+	tickPending = 0;
+
+	// Hold the back slot until it is complete again
+	USART0_frameDiscard();
+
+	char *frame = USART0_frameBuffer();
+
+#ifdef CLOCK_MINIMAL
+	// Same frame as the full build, written with the integer formatter
+	calculate_solar_position();
+	*frame++ = '<';
+	frame = formatNumber(frame, solar_params.year, 4, ' ');
+	frame = formatNumber(frame, solar_params.month, 2, '0');
+	frame = formatNumber(frame, solar_params.day, 2, '0');
+	frame = formatNumber(frame, solar_params.hour, 2, '0');
+	frame = formatNumber(frame, solar_params.minute, 2, '0');
+	frame = formatNumber(frame, solar_params.second, 2, '0');
+	frame = formatNumber(frame, solar_params.hundreds, TICK_DIGITS, '0');
+	*frame++ = '|';
+	frame = formatAngle(frame, solar_params.azimuth);
+	*frame++ = '|';
+	frame = formatAngle(frame, solar_params.elevation);
+	*frame++ = '|';
+	frame = formatAngle(frame, solar_params.latitude);
+	*frame++ = '|';
+	frame = formatAngle(frame, solar_params.longitude);
+	*frame++ = '|';
+	frame = formatNumber(frame, solar_params.timezone, 2, ' ');
+	*frame++ = '>';
+	*frame++ = '\r';
+	*frame++ = '\n';
+	*frame = '\0';
+#else
+	int length;
+
+	// Calculate solar position for every site (can be customized to update your solar data)
+	calculate_sites_position();
+	length = snprintf(frame, FRAME_SIZE, "<%4d%02d%02d%02d%02d%02d%0*d|%3.4f|%3.4f|%3.4f|%3.4f|%2d",
+		   solar_params.year, 
+		   solar_params.month, 
+		   solar_params.day, 
+		   solar_params.hour, 
+		   solar_params.minute, 
+		   solar_params.second, 
+		   TICK_DIGITS, solar_params.hundreds, 
+		   solar_params.azimuth, 
+		   solar_params.elevation,
+		   solar_params.latitude, //55.19419 * 10 = 551.9419
+		   solar_params.longitude,
+		   solar_params.timezone/*,
+		   solar_params.altitude*/ //moved to AVR64DD32
+		   );
+
+	// snprintf returns the length it wanted, keep the offset inside the slot
+	if (length < 0 || length > FRAME_SIZE - 1) {
+		length = FRAME_SIZE - 1;
+	}
+
+	// Additional sites are appended to the same frame as azimuth/elevation pairs
+	for (uint8_t i = 1; i < SOLAR_SITE_COUNT && length < FRAME_SIZE - 1; i++) {
+		length += snprintf(frame + length, FRAME_SIZE - length, "|%3.4f|%3.4f", solar_sites.azimuth[i], solar_sites.elevation[i]);
+		if (length > FRAME_SIZE - 1) {
+			length = FRAME_SIZE - 1;
+		}
+	}
+	snprintf(frame + length, FRAME_SIZE - length, ">\r\n");
+#endif
+	USART0_frameReady();
+}
+
+/**
+ * @brief Advances the clock in solar_params by one tick.
+ */
+static void RTC_advanceTick() {
+	solar_params.hundreds++;
+	if (solar_params.hundreds >= TICKS_PER_SECOND) {
+		solar_params.hundreds = 0;
+		solar_params.second++;
         
-			// Handle second overflow
-			if (solar_params.second >= 60) {
-				solar_params.second = 0;
-				solar_params.minute++;
+		// Handle second overflow
+		if (solar_params.second >= 60) {
+			solar_params.second = 0;
+			solar_params.minute++;
             
-				// Handle minute overflow
-				if (solar_params.minute >= 60) {
-					solar_params.minute = 0;
-					solar_params.hour++;
+			// Handle minute overflow
+			if (solar_params.minute >= 60) {
+				solar_params.minute = 0;
+				solar_params.hour++;
                 
-					// Handle hour overflow
-					if (solar_params.hour >= 24) {
-						solar_params.hour = 0;
-						solar_params.day++;
+				// Handle hour overflow
+				if (solar_params.hour >= 24) {
+					solar_params.hour = 0;
+					solar_params.day++;
                     
-						// Handle day overflow
-						uint8_t daysThisMonth = daysInMonth[solar_params.month - 1];
+					// Handle day overflow
+					uint8_t daysThisMonth = daysInMonth[solar_params.month - 1];
                     
-						// Account for leap year in February
-						if (solar_params.month == 2 && isLeapYear(solar_params.year)) {
-							daysThisMonth = 29;
-						}
+					// Account for leap year in February
+					if (solar_params.month == 2 && isLeapYear(solar_params.year)) {
+						daysThisMonth = 29;
+					}
                     
-						// If the day exceeds the number of days in the month, reset the day and increment the month
-						if (solar_params.day > daysThisMonth) {
-							solar_params.day = 1;
-							solar_params.month++;
+					// If the day exceeds the number of days in the month, reset the day and increment the month
+					if (solar_params.day > daysThisMonth) {
+						solar_params.day = 1;
+						solar_params.month++;
                         
-							// If the month exceeds 12, reset it to January and increment the year
-							if (solar_params.month > 12) {
-								solar_params.month = 1;
-								solar_params.year++;
-							}
+						// If the month exceeds 12, reset it to January and increment the year
+						if (solar_params.month > 12) {
+							solar_params.month = 1;
+							solar_params.year++;
 						}
 					}
 				}
 			}
 		}
-		//PORTA.OUTCLR = PIN5_bm;// toggling PIN5 otherwise to see led illumination will be not possible
 	}
-/*	else{
-		while(!(PORTB.IN & PIN1_bm)){ // if time is changing from outside
-			ClockAndDataSet(); //set new time
+}
+
+/**
+ * @brief Moves the clock in solar_params back by one tick.
+ */
+static void RTC_retreatTick() {
+	if (solar_params.hundreds > 0) {
+		solar_params.hundreds--;
+		return;
+	}
+	solar_params.hundreds = TICKS_PER_SECOND - 1;
+	if (solar_params.second > 0) {
+		solar_params.second--;
+		return;
+	}
+	solar_params.second = 59;
+	if (solar_params.minute > 0) {
+		solar_params.minute--;
+		return;
+	}
+	solar_params.minute = 59;
+	if (solar_params.hour > 0) {
+		solar_params.hour--;
+		return;
+	}
+	solar_params.hour = 23;
+	if (solar_params.day > 1) {
+		solar_params.day--;
+		return;
+	}
+
+	// Step back to the last day of the previous month
+	if (solar_params.month > 1) {
+		solar_params.month--;
+	} else {
+		solar_params.month = 12;
+		solar_params.year--;
+	}
+	solar_params.day = daysInMonth[solar_params.month - 1];
+	if (solar_params.month == 2 && isLeapYear(solar_params.year)) {
+		solar_params.day = 29;
+	}
+}
+
+/**
+ * @brief Moves the RTC phase to the given count, stepping the clock by whole ticks as needed.
+ * 
+ * Must be called with interrupts disabled.
+ * 
+ * @param phase The new count within the current tick (may be outside 0..RTC_TICK_COUNTS-1).
+ */
+static void RTC_setPhase(int32_t phase) {
+	while (phase >= RTC_TICK_COUNTS) {
+		phase -= RTC_TICK_COUNTS;
+		RTC_advanceTick();
+	}
+	while (phase < 0) {
+		phase += RTC_TICK_COUNTS;
+		RTC_retreatTick();
+	}
+	while (RTC.STATUS & RTC_CNTBUSY_bm); // Wait until CNT can be written
+	RTC.CNT = phase;
+
+	// The clock fields may have moved, arm the heartbeat for the new tick
+	Heartbeat_tick();
+}
+
+/**
+ * @brief Takes a timestamp of the RTC (free running tick counter and counter value).
+ * 
+ * Safe to call from interrupts and from the main loop. An overflow that is still
+ * waiting for its interrupt is already counted in the stamp.
+ * 
+ * @param stamp Receives the timestamp.
+ */
+void RTC_stamp(RtcStamp *stamp) {
+	uint8_t sreg = SREG;
+	cli();
+	stamp->ticks = tickCount;
+	stamp->count = RTC.CNT;
+	if (RTC.INTFLAGS & RTC_OVF_bm) {
+		// Overflow not handled yet, read again so the count is surely after it
+		stamp->count = RTC.CNT;
+		stamp->ticks++;
+	}
+	SREG = sreg;
+}
+
+/**
+ * @brief Returns the RTC counts elapsed since a timestamp.
+ * 
+ * @param since The earlier timestamp.
+ * @return int32_t Elapsed counts (1 count = 1.6 us).
+ */
+int32_t RTC_elapsed(const RtcStamp *since) {
+	RtcStamp now;
+	RTC_stamp(&now);
+	return (int32_t)(now.ticks - since->ticks) * RTC_TICK_COUNTS + now.count - since->count;
+}
+
+/**
+ * @brief Converts a timestamp to the local time of day of the clock.
+ * 
+ * @param stamp The timestamp (must not be older than a time change).
+ * @param seconds Receives the seconds of the day (0-86399).
+ * @param micros Receives the microseconds within the second.
+ */
+void RTC_timeOfDay(const RtcStamp *stamp, uint32_t *seconds, uint32_t *micros) {
+	uint8_t sreg = SREG;
+	cli();
+	int32_t day_seconds = solar_params.hour * 3600L + solar_params.minute * 60 + solar_params.second;
+
+	// The clock fields show the start of tick tickCount, the stamp may be a few ticks away from it
+	int32_t us = ((int32_t)solar_params.hundreds + (int32_t)(stamp->ticks - tickCount)) * (1000000L / TICKS_PER_SECOND)
+	           + (int32_t)stamp->count * 8 / 5;
+	SREG = sreg;
+
+	while (us < 0) {
+		us += 1000000L;
+		day_seconds--;
+	}
+	while (us >= 1000000L) {
+		us -= 1000000L;
+		day_seconds++;
+	}
+	if (day_seconds < 0) {
+		day_seconds += 86400L;
+	} else if (day_seconds >= 86400L) {
+		day_seconds -= 86400L;
+	}
+	*seconds = day_seconds;
+	*micros = us;
+}
+
+/**
+ * @brief Shifts the clock by the given number of RTC counts, adjusting RTC.CNT and the tick together.
+ * 
+ * @param counts The correction (positive moves the clock forward).
+ */
+void RTC_adjust(int32_t counts) {
+	uint8_t sreg = SREG;
+	cli();
+	RtcStamp now;
+	RTC_stamp(&now);
+	RTC_setPhase((int32_t)now.count + counts);
+	SREG = sreg;
+}
+
+/**
+ * @brief Aligns the RTC phase after the clock fields were set to the time of an earlier moment.
+ * 
+ * @param start Timestamp of the moment the new clock fields refer to.
+ * @param extra Additional counts that passed before that timestamp was taken.
+ */
+void RTC_align(const RtcStamp *start, int32_t extra) {
+	uint8_t sreg = SREG;
+	cli();
+	int32_t phase = RTC_elapsed(start) + extra;
+	if (RTC.INTFLAGS & RTC_OVF_bm) {
+		// The pending overflow belongs to the old time, count it here instead
+		RTC.INTFLAGS = RTC_OVF_bm;
+		tickCount++;
+	}
+	RTC_setPhase(phase);
+	SREG = sreg;
+}
+
+/**
+ * @brief Interrupt handler for RTC overflow. Sends the prepared frame and updates the time.
+ * 
+ * The heartbeat LED is driven by the overflow event in hardware (see Heartbeat.c), not from here.
+ * 
+ * The clock keeps running while the clock set input is held low, only the frames are
+ * not sent then, so the bus stays free for the host.
+ */
+ISR(RTC_CNT_vect) {
+    RTC.INTFLAGS = RTC_OVF_bm; // Clear the overflow interrupt flag
+	tickCount++;
+    
+	if(SET_PORT.IN & SET_PIN_bm){ //If time is not changat from outside
+		// Put the frame prepared during the previous tick on the wire
+		if (!USART0_frameSwap()) {
+			linkStats.missed++;
 		}
-	}*/
+	}
+
+	// Increment milliseconds and handle time overflow
+	RTC_advanceTick();
+
+	// The heartbeat pulse of this tick is already running (started by the overflow event), arm the next one
+	Heartbeat_tick();
+
+	// Let the main loop prepare the frame for the new time
+	tickPending = 1;
 }
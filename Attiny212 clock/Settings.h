@@ -17,14 +17,88 @@
 // Adding 0.5 for rounding
 #define USART0_BAUD_RATE(BAUD_RATE) ((float)(F_CPU * 64 / (8 *(float)BAUD_RATE)) + 0.5)
 
+// Number of RTC ticks (output frames) per second, the RTC runs from F_CPU / 32
+#define TICKS_PER_SECOND 20
+
+// RTC counts per tick (one count = 1.6 us)
+#define RTC_TICK_COUNTS ((F_CPU / 32) / TICKS_PER_SECOND)
+
+// A tick must be a whole number of RTC counts and microseconds and fit the 16-bit RTC.PER
+#if (F_CPU / 32) % TICKS_PER_SECOND != 0 || 1000000L % TICKS_PER_SECOND != 0 || RTC_TICK_COUNTS > 65536 || TICKS_PER_SECOND > 100
+#error "TICKS_PER_SECOND must divide F_CPU / 32 and 1000000 and be between (F_CPU / 32) / 65536 and 100"
+#endif
+
+// Digits of the tick number (0 to TICKS_PER_SECOND - 1) in frames and commands
+#if TICKS_PER_SECOND > 10
+#define TICK_DIGITS 2
+#define TICK_SCAN "%2u"
+#else
+#define TICK_DIGITS 1
+#define TICK_SCAN "%1u"
+#endif
+
+// USART0 baud rate, also used to compensate the time a command spends on the wire
+#define USART0_BAUD 2500000
+
+// Size of the command receive buffer, including the terminating null
+#define COMMAND_SIZE 40
+
+// Minimal build profile (ATtiny212/412): define CLOCK_MINIMAL in the project symbols (see the "Minimal"
+// configuration) to strip stdio, libm and the multi-site table and use the fixed point solar model
+
+#ifdef CLOCK_MINIMAL
+// Size of one output frame slot, including the terminating null
+#define FRAME_SIZE 64
+
+// One frame slot only (RAM), it is filled again once the previous frame has left the wire
+#define FRAME_SLOTS 1
+
+// 8-pin package: USART0 on PA6 (TX) / PA7 (RX), clock set input on PA1, LED on PA2 (PA3 is EXTCLK)
+#define LED_PORT PORTA
+#define LED_PIN_bm PIN2_bm
+#define SET_PORT PORTA
+#define SET_PIN_bm PIN1_bm
+#define USART0_PORT PORTA
+#define USART0_TX_bm PIN6_bm
+#define USART0_RX_bm PIN7_bm
+#define USART0_TX_PINCTRL PORTA.PIN6CTRL
+#define USART0_RX_PINCTRL PORTA.PIN7CTRL
+
+// PA2 is not a TCB0 output, the heartbeat reaches the LED through CCL LUT0 and EVOUT0
+#define LED_EVOUT
+#else
+// Size of one output frame slot, including the terminating null (each extra site adds "|azimuth|elevation")
+#define FRAME_SIZE (80 + 20 * (SOLAR_SITE_COUNT - 1))
+
+// Two frame slots: the next frame is prepared while the previous one is being sent
+#define FRAME_SLOTS 2
+
+// 14-pin package: USART0 on PB2 (TX) / PB3 (RX), clock set input on PB1, LED on PA5
+#define LED_PORT PORTA
+#define LED_PIN_bm PIN5_bm
+#define SET_PORT PORTB
+#define SET_PIN_bm PIN1_bm
+#define USART0_PORT PORTB
+#define USART0_TX_bm PIN2_bm
+#define USART0_RX_bm PIN3_bm
+#define USART0_TX_PINCTRL PORTB.PIN2CTRL
+#define USART0_RX_PINCTRL PORTB.PIN3CTRL
+
+// Uncomment to repeat the heartbeat pulses on PA4 (CCL LUT0 output) as a hardware tick/PPS for other boards
+//#define PPS_OUT
+#endif
+
 #include <avr/io.h>      // Include AVR I/O library for register definitions and hardware control
 #include <avr/interrupt.h> // Include AVR interrupt library for ISR (Interrupt Service Routine) support
+#include <stddef.h>      // Include stddef.h for NULL and size_t
+#include <stdbool.h>     // Include stdbool.h for boolean type support (true/false)
+#ifndef CLOCK_MINIMAL
 #include <stdio.h>       // Include standard I/O library for functions like printf
 #include <string.h>      // Include string library for handling string functions like strlen
 #include <stdlib.h> 
 #include <math.h>        // Include math library for mathematical functions (e.g., sin, cos)
 #include <float.h>       // Include float.h for floating point constants like FLT_MAX
-#include <stdbool.h>     // Include stdbool.h for boolean type support (true/false)
+#endif
 #include "Cosmos.h"      // Include Cosmos.h (This is for solar calculation and related functions)
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -64,6 +138,7 @@ void USART0_init();
  */
 void USART0_sendChar(char c);
 
+#ifndef CLOCK_MINIMAL
 /**
  * @brief Custom output function for printf-style printing via USART0.
  * 
@@ -75,6 +150,7 @@ void USART0_sendChar(char c);
  * @return int 0 to indicate the character was successfully sent.
  */
 int USART0_printChar(char c, FILE *stream);
+#endif
 
 /**
  * @brief Sends a string via USART0.
@@ -96,7 +172,182 @@ void USART0_sendString(char *str);
  */
 char USART0_readChar();
 
+#ifndef CLOCK_MINIMAL
 void USART0_printf(const char *format, ...);
+#endif
+
+/**
+ * @brief Returns the back frame slot, which is free to be filled with the next frame.
+ * 
+ * @return char* Pointer to a buffer of FRAME_SIZE bytes.
+ */
+char *USART0_frameBuffer();
+
+/**
+ * @brief Marks the back frame slot as complete, so the next tick may send it.
+ */
+void USART0_frameReady();
+
+/**
+ * @brief Drops the frame waiting in the back slot (e.g. after the time was changed).
+ */
+void USART0_frameDiscard();
+
+/**
+ * @brief Swaps the frame slots and starts interrupt driven transmission of the new front slot.
+ * 
+ * @return uint8_t 1 if a frame transmission was started (or deferred behind a command reply), 0 otherwise.
+ */
+uint8_t USART0_frameSwap();
+
+/**
+ * @brief Tells whether a frame is still being transmitted.
+ * 
+ * @return uint8_t 1 from a frame start (or a frame deferred behind a reply) until its last stop bit has been sent, 0 when idle.
+ */
+uint8_t USART0_frameSending();
+
+/**
+ * @brief Holds back frame transmission, so a command reply can use the line.
+ * 
+ * @param hold 1 to hold frames (waits until the current frame is sent), 0 to release (sends a frame
+ *             of a tick that fell into the hold).
+ */
+void USART0_frameHold(uint8_t hold);
+
+// Frame latency histogram: LATENCY_BINS bins of LATENCY_BIN_COUNTS RTC counts, the last bin collects the rest.
+// The bin width is the smallest power of two that lets a full frame fit into LATENCY_BINS - 2 bins,
+// the rest is left for late frames. A power of two keeps the binning in the interrupt a shift.
+#define LATENCY_BINS 8
+#define LATENCY_FRAME_COUNTS (FRAME_SIZE * 10L * (F_CPU / 32) / USART0_BAUD)
+#if LATENCY_FRAME_COUNTS <= (LATENCY_BINS - 2) * 16L
+#define LATENCY_BIN_SHIFT 4
+#elif LATENCY_FRAME_COUNTS <= (LATENCY_BINS - 2) * 32L
+#define LATENCY_BIN_SHIFT 5
+#elif LATENCY_FRAME_COUNTS <= (LATENCY_BINS - 2) * 64L
+#define LATENCY_BIN_SHIFT 6
+#elif LATENCY_FRAME_COUNTS <= (LATENCY_BINS - 2) * 128L
+#define LATENCY_BIN_SHIFT 7
+#else
+#define LATENCY_BIN_SHIFT 8
+#endif
+#define LATENCY_BIN_COUNTS (1U << LATENCY_BIN_SHIFT)
+
+/**
+ * @brief Link statistics for soak runs, read with the "<D|0>" command or in the debugger.
+ * 
+ * The counters wrap after 65535 (54.6 minutes of frames at 20 ticks per second), so read and
+ * reset them ("<D|1>") well before that.
+ */
+typedef struct {
+    uint16_t frames;       /**< Frames sent */
+    uint16_t missed;       /**< Ticks with the set input high that sent no frame */
+    uint16_t latency_min;  /**< Shortest time from the RTC overflow to the last stop bit of a frame (RTC counts) */
+    uint16_t latency_max;  /**< Longest time from the RTC overflow to the last stop bit of a frame (RTC counts) */
+    uint16_t latency_histogram[LATENCY_BINS]; /**< Frames per latency bin */
+    uint16_t rx_dropped;   /**< Commands dropped: too long, or started while the previous one was waiting */
+    uint16_t rx_invalid;   /**< Commands not understood or with bad parameters */
+    uint16_t rx_errors;    /**< Characters received with a framing, parity or overrun error */
+} LinkStats;
+
+// Declare the global link statistics, updated by the USART0 and RTC interrupts
+extern volatile LinkStats linkStats;
+
+/**
+ * @brief Clears the link statistics.
+ */
+void USART0_statsReset();
+
+/**
+ * @brief Computes the solar position for the upcoming tick and formats it into the back frame slot.
+ * 
+ * Called from the main loop. Does nothing unless the RTC interrupt has requested a new frame,
+ * so the calculation runs while the previous frame is still being transmitted.
+ */
+void RTC_prepareFrame();
+
+// Set by the RTC interrupt (or after a time change) when the next frame has to be prepared
+extern volatile uint8_t tickPending;
+
+// Heartbeat modes (LED on PA5 and the optional PPS output), set with the "<L|mode>" command
+#define HEARTBEAT_OFF 0     // No pulses
+#define HEARTBEAT_SECOND 1  // One pulse at the start of every second
+#define HEARTBEAT_TICK 2    // One pulse at the start of every tick
+#define HEARTBEAT_SYNC 3    // Tick pulses only while a sync exchange is in progress
+
+/**
+ * @brief Sets up the hardware heartbeat: RTC overflow event -> EVSYS -> TCB0 single-shot pulse on the LED pin.
+ */
+void Heartbeat_init();
+
+/**
+ * @brief Selects the heartbeat mode.
+ * 
+ * @param mode One of the HEARTBEAT_ modes.
+ */
+void Heartbeat_setMode(uint8_t mode);
+
+/**
+ * @brief Marks the start (1) or the end (0) of a sync exchange, for HEARTBEAT_SYNC.
+ * 
+ * @param active 1 when a sync request has arrived, 0 when the correction was applied.
+ */
+void Heartbeat_sync(uint8_t active);
+
+/**
+ * @brief Arms or disarms the pulse for the next tick. Called by the RTC interrupt after the clock advanced.
+ */
+void Heartbeat_tick();
+
+/**
+ * @brief Timestamp of the RTC, independent of the clock fields (which can be set).
+ */
+typedef struct {
+    uint32_t ticks;  /**< Free running tick counter */
+    uint16_t count;  /**< RTC.CNT within that tick */
+} RtcStamp;
+
+// Free running tick counter of the timestamps, advanced by the RTC interrupt
+extern volatile uint32_t tickCount;
+
+/**
+ * @brief Takes a timestamp of the RTC. Safe to call from interrupts.
+ * 
+ * @param stamp Receives the timestamp.
+ */
+void RTC_stamp(RtcStamp *stamp);
+
+/**
+ * @brief Returns the RTC counts elapsed since a timestamp.
+ * 
+ * @param since The earlier timestamp.
+ * @return int32_t Elapsed counts (1 count = 1.6 us).
+ */
+int32_t RTC_elapsed(const RtcStamp *since);
+
+/**
+ * @brief Converts a timestamp to the local time of day of the clock.
+ * 
+ * @param stamp The timestamp (must not be older than a time change).
+ * @param seconds Receives the seconds of the day (0-86399).
+ * @param micros Receives the microseconds within the second.
+ */
+void RTC_timeOfDay(const RtcStamp *stamp, uint32_t *seconds, uint32_t *micros);
+
+/**
+ * @brief Shifts the clock by the given number of RTC counts, adjusting RTC.CNT and the tick together.
+ * 
+ * @param counts The correction (positive moves the clock forward).
+ */
+void RTC_adjust(int32_t counts);
+
+/**
+ * @brief Aligns the RTC phase after the clock fields were set to the time of an earlier moment.
+ * 
+ * @param start Timestamp of the moment the new clock fields refer to.
+ * @param extra Additional counts that passed before that timestamp was taken.
+ */
+void RTC_align(const RtcStamp *start, int32_t extra);
 
 /**
  * @brief Calculates the solar position based on the current date, time, and location.
@@ -108,17 +359,118 @@ void USART0_printf(const char *format, ...);
 void calculate_solar_position();
 
 /**
- * @brief Reads and processes a command from USART0, updating solar parameters.
+ * @brief Calculates the solar position for the date, time and location in the given parameters.
+ * 
+ * Reentrant variant of calculate_solar_position(): it works only on the given structure,
+ * so a query for any moment does not touch the live clock in solar_params.
  * 
- * This function listens for a command from the USART0 port, starting to read
- * when the '<' character is encountered, and stops reading when the '>' character
- * is detected. It stores the incoming characters in a buffer and passes the command
- * to `executeCommand()` for further processing once the full command has been received.
+ * @param params Date, time, timezone and location; receives the elevation and azimuth.
+ */
+void calculate_solar_position_at(volatile SolarPositionParameters *params);
+
+#ifndef CLOCK_MINIMAL
+/**
+ * @brief Calculates the time dependent solar terms shared by every site.
+ * 
+ * @param params The date, time and timezone to calculate for.
+ * @param eph Receives the shared solar terms.
+ */
+void calculate_solar_ephemeris(const volatile SolarPositionParameters *params, SolarEphemeris *eph);
+
+/**
+ * @brief Calculates the solar elevation and azimuth for one site from the shared solar terms.
+ * 
+ * @param eph The shared terms from calculate_solar_ephemeris().
+ * @param longitude Longitude of the site (in degrees).
+ * @param sin_latitude Sine of the site latitude.
+ * @param cos_latitude Cosine of the site latitude.
+ * @param elevation Receives the solar elevation (in degrees).
+ * @param azimuth Receives the solar azimuth (in degrees).
+ */
+void calculate_site_position(const SolarEphemeris *eph, double longitude, double sin_latitude, double cos_latitude, double *elevation, double *azimuth);
+
+/**
+ * @brief Precalculates the latitude terms of every configured site. Call once at startup.
+ */
+void init_solar_sites();
+
+/**
+ * @brief Calculates the solar position for every configured site at the current time.
+ * 
+ * The shared terms (Julian Day, declination, equation of time, distance) are calculated
+ * once per call, each additional site only costs its hour angle, elevation and azimuth.
+ */
+void calculate_sites_position();
+#endif
+
+/**
+ * @brief Checks if daylight saving time (DST) is in effect for the given date.
+ * 
+ * @param year The year to check.
+ * @param month The month to check.
+ * @param day The day of the month to check.
+ * @return True if DST is in effect, otherwise false.
+ */
+bool is_daylight_saving_time(int year, int month, int day);
+
+/**
+ * @brief Checks whether a given year is a leap year.
+ * 
+ * @param year The year to check.
+ * @return uint8_t Returns 1 if the year is a leap year, 0 otherwise.
+ */
+uint8_t isLeapYear(uint16_t year);
+
+// Number of days in each month (Non-leap year)
+extern const uint8_t daysInMonth[];
+
+/**
+ * @brief Writes a signed integer as decimal text (printf replacement for integers).
+ * 
+ * @param out Where to write the text (not null terminated).
+ * @param value The value to write.
+ * @param width Minimum number of characters, padded on the left.
+ * @param pad The padding character (' ' or '0').
+ * @return char* Pointer just past the written text.
+ */
+char *formatNumber(char *out, int32_t value, uint8_t width, char pad);
+
+/**
+ * @brief Reads a decimal integer with an optional sign (sscanf/atoi replacement for integers).
+ * 
+ * @param text Pointer to the text position, advanced past the number.
+ * @param digits Maximum number of digits to read (0 for no limit).
+ * @return int32_t The value read.
+ */
+int32_t parseNumber(const char **text, uint8_t digits);
+
+#ifdef CLOCK_MINIMAL
+/**
+ * @brief Writes an angle in 1/10000 of a degree as decimal degrees with 4 decimals.
+ * 
+ * @param out Where to write the text (not null terminated).
+ * @param value The angle.
+ * @return char* Pointer just past the written text.
+ */
+char *formatAngle(char *out, solar_angle_t value);
+
+/**
+ * @brief Reads decimal degrees as an angle in 1/10000 of a degree (atof replacement for the minimal build).
+ * 
+ * @param text Pointer to the text position, advanced past the number.
+ * @return solar_angle_t The angle read.
+ */
+solar_angle_t parseAngle(const char **text);
+#endif
+
+/**
+ * @brief Processes a command received by the USART0 interrupt, if there is one.
  * 
- * @note This function uses a simple state machine to capture the command string.
- *       The command string is expected to be enclosed by '<' and '>' characters.
+ * Commands are enclosed by '<' and '>' characters. Time set commands
+ * ("YYYYMMDDHHMMSSX|TZ|LAT|LON") are applied only while the clock set input is held low,
+ * the sync commands ("S|..." and "O|...") are answered at any time.
  * 
- * @see executeCommand() for processing the command after it's fully received.
+ * @see executeCommand() for processing the time set command.
  */
 void ClockAndDataSet();
 
@@ -6,8 +6,22 @@
  */ 
 #include "Settings.h"
 
+#ifndef CLOCK_MINIMAL
 // Setup a stream for USART0 with a custom write function (USART0_printChar).
 static FILE USART_stream = FDEV_SETUP_STREAM(USART0_printChar, NULL, _FDEV_SETUP_WRITE);
+#endif
+
+// Frame slots: the front one is drained by the DRE interrupt while the back one is being filled
+// (with a single slot, front and back are the same and it is filled after transmission)
+static char frameBuffer[FRAME_SLOTS][FRAME_SIZE];
+static volatile uint8_t frameFront = 0;      // Index of the slot owned by the transmitter
+static volatile uint8_t frameBackReady = 0;  // Back slot holds a complete frame waiting for a tick
+static volatile uint8_t frameHeld = 0;       // Frames are held back while a command reply is sent
+static volatile uint8_t frameDeferred = 0;   // A tick fell into the hold, its frame follows the reply
+static const char * volatile frameTx = NULL; // Next byte to transmit, NULL while the transmitter is idle
+static uint8_t frameTick;                    // Low byte of the tick of the frame on the wire, for the latency statistics
+
+volatile LinkStats linkStats = { .latency_min = 0xFFFF };
 
 /**
  * @brief Initializes USART0 for serial communication at 115200 baud rate.
@@ -19,16 +33,21 @@ void USART0_init() {
     // USART0.CTRLA = USART_RS485_0_bm; // Enable RS485 driver control (optional, commented out)
     
     // Set the baud rate to 115200 bps
-    USART0.BAUD = (uint16_t)USART0_BAUD_RATE(/*230400*/ 2500000);
+    USART0.BAUD = (uint16_t)USART0_BAUD_RATE(/*230400*/ USART0_BAUD);
 
     // Enable receiver and transmitter, configure for double speed mode
     USART0.CTRLB = USART_RXEN_bm | USART_TXEN_bm | USART_RXMODE_CLK2X_gc;
 
+    // Commands are received by the receive complete interrupt
+    USART0.CTRLA |= USART_RXCIE_bm;
+
     // Configure USART0 for asynchronous communication, 8-bit data, no parity, and 1 stop bit
     USART0.CTRLC = USART_CMODE_ASYNCHRONOUS_gc | USART_CHSIZE_8BIT_gc | USART_PMODE_DISABLED_gc | USART_SBMODE_1BIT_gc;
 
+#ifndef CLOCK_MINIMAL
     // Set the output stream to use USART0 for printing
     stdout = &USART_stream;
+#endif
 }
 
 /**
@@ -47,6 +66,7 @@ void USART0_sendChar(char c) {
     USART0.TXDATAL = c;
 }
 
+#ifndef CLOCK_MINIMAL
 /**
  * @brief Custom write function to output a character to USART0.
  * 
@@ -62,6 +82,7 @@ int USART0_printChar(char c, FILE *stream) {
     USART0_sendChar(c);
     return 0; // Return 0 to indicate success
 }
+#endif
 
 /**
  * @brief Sends a string via USART0.
@@ -73,8 +94,8 @@ int USART0_printChar(char c, FILE *stream) {
  */
 void USART0_sendString(char *str) {
     // Iterate through each character of the string and send it via USART0
-    for (size_t i = 0; i < strlen(str); i++) {
-        USART0_sendChar(str[i]);
+    while (*str != '\0') {
+        USART0_sendChar(*str++);
     }
 }
 
@@ -98,6 +119,7 @@ char USART0_readChar() {
 }
 
 
+#ifndef CLOCK_MINIMAL
 void USART0_printf(const char *format, ...) {
 	char buffer[128]; // Laikinas buferis praneimui
 	va_list args;
@@ -105,4 +127,177 @@ void USART0_printf(const char *format, ...) {
 	vsnprintf(buffer, sizeof(buffer), format, args); // Formatuojame praneim  bufer
 	va_end(args);
 	USART0_sendString(buffer); // Naudojame USART0 siuntimo funkcij
-}
\ No newline at end of file
+}
+#endif
+
+/**
+ * @brief Returns the back frame slot, which is free to be filled with the next frame.
+ * 
+ * @return char* Pointer to a buffer of FRAME_SIZE bytes.
+ */
+char *USART0_frameBuffer() {
+#if FRAME_SLOTS > 1
+    return frameBuffer[frameFront ^ 1];
+#else
+    return frameBuffer[0];
+#endif
+}
+
+/**
+ * @brief Marks the back frame slot as complete, so the next tick may send it.
+ */
+void USART0_frameReady() {
+    frameBackReady = 1;
+}
+
+/**
+ * @brief Drops the frame waiting in the back slot (e.g. after the time was changed).
+ */
+void USART0_frameDiscard() {
+    frameBackReady = 0;
+}
+
+/**
+ * @brief Makes the back slot the front slot and starts its interrupt driven transmission.
+ */
+static void frameStart() {
+#if FRAME_SLOTS > 1
+    frameFront ^= 1;
+#endif
+    frameBackReady = 0;
+    frameTx = frameBuffer[frameFront];
+
+    // The DRE interrupt fires immediately and keeps feeding the transmitter
+    USART0.CTRLA |= USART_DREIE_bm;
+}
+
+/**
+ * @brief Swaps the frame slots and starts interrupt driven transmission of the new front slot.
+ * 
+ * Called at the tick boundary. Nothing is sent if the back slot is not complete yet
+ * or if the previous frame is still on the wire. While a command reply holds the line,
+ * the frame is sent right after the reply instead.
+ * 
+ * @return uint8_t 1 if a frame transmission was started or deferred, 0 otherwise.
+ */
+uint8_t USART0_frameSwap() {
+    if (!frameBackReady || frameTx != NULL) {
+        return 0;
+    }
+
+    // Called by the RTC interrupt after the tick counter advanced to this tick
+    frameTick = (uint8_t)tickCount;
+
+    if (frameHeld) {
+        frameDeferred = 1;
+    }
+    else {
+        frameStart();
+    }
+    return 1;
+}
+
+/**
+ * @brief Tells whether a frame is still being transmitted.
+ * 
+ * @return uint8_t 1 from a frame start (or a frame deferred behind a reply) until its last stop bit has been sent, 0 when idle.
+ */
+uint8_t USART0_frameSending() {
+    return frameTx != NULL || frameDeferred;
+}
+
+/**
+ * @brief Holds back frame transmission, so a command reply can use the line.
+ * 
+ * The reply is queued behind the frame on the wire. The frame of a tick that falls into
+ * the hold is sent as soon as the hold is released, right behind the reply. A reply is far
+ * shorter than a tick, so at most one frame is deferred.
+ * 
+ * @param hold 1 to hold frames (waits until the current frame is sent), 0 to release.
+ */
+void USART0_frameHold(uint8_t hold) {
+    if (hold) {
+        frameHeld = 1;
+
+        // Let a frame that is already on the wire finish
+        while (frameTx != NULL);
+        return;
+    }
+
+    uint8_t sreg = SREG;
+    cli();
+    frameHeld = 0;
+    if (frameDeferred) {
+        frameDeferred = 0;
+        frameStart();
+    }
+    SREG = sreg;
+}
+
+/**
+ * @brief Interrupt handler for an empty USART0 data register. Sends the next byte of the front frame.
+ */
+ISR(USART0_DRE_vect) {
+    USART0.TXDATAL = *frameTx++;
+
+    // Stop at the terminating null, the transmit complete interrupt releases the slot
+    if (*frameTx == '\0') {
+        // A gap in the frame may have set TXCIF already, only the end of the last byte may count
+        USART0.STATUS = USART_TXCIF_bm;
+        USART0.CTRLA = (USART0.CTRLA & ~USART_DREIE_bm) | USART_TXCIE_bm;
+    }
+}
+
+/**
+ * @brief Interrupt handler for USART0 transmit complete. Releases the frame slot and records the frame latency.
+ * 
+ * The latency runs from the RTC overflow that started the tick to the last stop bit of the frame.
+ * Only 16 bit arithmetic is used, so the handler stays short enough not to delay received characters.
+ */
+ISR(USART0_TXC_vect) {
+    uint16_t count = RTC.CNT;
+    uint8_t ticks = (uint8_t)tickCount - frameTick;
+    uint16_t latency;
+
+    USART0.STATUS = USART_TXCIF_bm;
+    USART0.CTRLA &= ~USART_TXCIE_bm;
+    frameTx = NULL;
+
+    if (RTC.INTFLAGS & RTC_OVF_bm) {
+        // Overflow not handled yet, read again so the count is surely after it
+        count = RTC.CNT;
+        ticks++;
+    }
+    // A frame ends in its own tick or the next one, anything later saturates
+    if (ticks == 0) {
+        latency = count;
+    }
+    else if (ticks == 1 && count < 0xFFFF - RTC_TICK_COUNTS) {
+        latency = count + RTC_TICK_COUNTS;
+    }
+    else {
+        latency = 0xFFFF;
+    }
+    linkStats.frames++;
+    if (latency < linkStats.latency_min) {
+        linkStats.latency_min = latency;
+    }
+    if (latency > linkStats.latency_max) {
+        linkStats.latency_max = latency;
+    }
+    uint16_t bin = latency >> LATENCY_BIN_SHIFT;
+    if (bin >= LATENCY_BINS) {
+        bin = LATENCY_BINS - 1;
+    }
+    linkStats.latency_histogram[bin]++;
+}
+
+/**
+ * @brief Clears the link statistics.
+ */
+void USART0_statsReset() {
+    uint8_t sreg = SREG;
+    cli();
+    linkStats = (LinkStats){ .latency_min = 0xFFFF };
+    SREG = sreg;
+}
@@ -23,18 +23,25 @@ int main(void)
     
     // Initialize the RTC (Real-Time Clock) for timekeeping
     RTC_init();
+
+    // Route the RTC overflow to the heartbeat LED (and the PPS output) through the event system
+    Heartbeat_init();
+
+#ifndef CLOCK_MINIMAL
+    // Precalculate the latitude terms of the configured tracker sites
+    init_solar_sites();
+#endif
     
     // Enable global interrupts to allow interrupt-driven operations
     sei();
     
-    // Enter an infinite loop (the actual work is done in interrupts)
+    // Enter an infinite loop (timekeeping and transmission are done in interrupts)
     while (1) 
     {
-		while(!(PORTB.IN & PIN1_bm)){ // if time is changing from outside
-			ClockAndDataSet();
-		}
-        // Main loop does nothing here as interrupt service routines handle the tasks
-        // The RTC interrupt will update time and calculate solar position periodically
+		// Commands are collected by the USART0 interrupt, handle a complete one if there is any
+		ClockAndDataSet();
+
+		RTC_prepareFrame();
     }
 }
 
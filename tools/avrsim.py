@@ -0,0 +1,310 @@
+"""Host simulator of the clock firmware, driven from Python.
+
+The firmware sources of "Attiny212 clock" are compiled for the host together with
+the peripheral model in tools/sim (RTC, USART0, ports, TCB0 event input) and loaded
+with ctypes. Simulated time is counted in device CPU cycles; the host side works in
+true seconds, which differ from device seconds by the crystal error (drift_ppm).
+
+Code between two register accesses takes no simulated time. Interrupt handlers, main
+loop passes and the solar position calculations are charged the costs in sim_costs,
+which are estimates (see COSTS), not measurements of the AVR code.
+"""
+
+import ctypes
+import hashlib
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+SIM = os.path.join(TOOLS, "sim")
+FIRMWARE = os.path.join(os.path.dirname(TOOLS), "Attiny212 clock")
+
+SOURCES = [os.path.join(SIM, name) for name in ("sim.c", "sim_main.c", "sim_usart.c", "sim_comm.c")] + [
+    os.path.join(FIRMWARE, name) for name in ("RTC.c", "Heartbeat.c", "GPIO.c", "Cosmos.c", "CosmosFixed.c")
+]
+HEADERS = [os.path.join(SIM, name) for name in ("sim.h", "include/avr/io.h", "include/avr/interrupt.h")] + [
+    os.path.join(FIRMWARE, name) for name in
+    ("Settings.h", "Cosmos.h", "CosmosVar.h", "main.c", "USART.c", "Communications.c")
+]
+
+# Modeled costs in CPU cycles (20 MHz: 20 cycles = 1 us). Frame and query are the
+# solar position (and for frames the formatting) with avr-libc float in the full
+# build and the fixed point model in the minimal build. A frame is charged frame for
+# site 0 and site for every further site: the hour angle, elevation, azimuth (about
+# eight libm calls) and two "%3.4f" fields, while the time dependent terms are shared.
+# The minimal build has one site only.
+COSTS = {
+    "full": dict(isr_rtc=200, isr_rxc=70, isr_dre=50, isr_txc=120, access=1, loop=40, frame=90000, site=25000,
+                 query=70000),
+    "minimal": dict(isr_rtc=200, isr_rxc=70, isr_dre=50, isr_txc=120, access=1, loop=40, frame=30000, site=0,
+                    query=24000),
+}
+
+SIM_RX_FERR = 0x04
+SIM_RX_PERR = 0x02
+
+
+class SimCosts(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint32) for name in
+                ("isr_rtc", "isr_rxc", "isr_dre", "isr_txc", "access", "loop", "frame", "site", "query")]
+
+
+class SimFirmwareInfo(ctypes.Structure):
+    _fields_ = [("f_cpu", ctypes.c_uint32), ("baud", ctypes.c_uint32), ("ticks_per_second", ctypes.c_uint16),
+                ("rtc_tick_counts", ctypes.c_uint16), ("frame_slots", ctypes.c_uint8), ("minimal", ctypes.c_uint8),
+                ("set_port", ctypes.c_uint8), ("set_pin_bm", ctypes.c_uint8), ("latency_bin_counts", ctypes.c_uint16),
+                ("latency_bins", ctypes.c_uint8), ("command_size", ctypes.c_uint8), ("site_count", ctypes.c_uint8)]
+
+
+class SimTxChar(ctypes.Structure):
+    _fields_ = [("start", ctypes.c_uint64), ("end", ctypes.c_uint64), ("data", ctypes.c_uint8)]
+
+
+class SimPulse(ctypes.Structure):
+    _fields_ = [("start", ctypes.c_uint64), ("length", ctypes.c_uint32)]
+
+
+def site_defines(sites):
+    """Project symbols for a site table, sites is [(latitude, longitude)] of sites 1 and up."""
+    if not sites:
+        return []
+    return ["-DSOLAR_SITE_COUNT=%d" % (len(sites) + 1),
+            "-DSOLAR_SITE_LATITUDES=" + ",".join(repr(float(latitude)) for latitude, _ in sites),
+            "-DSOLAR_SITE_LONGITUDES=" + ",".join(repr(float(longitude)) for _, longitude in sites)]
+
+
+def build(minimal=False, sites=(), cc="gcc"):
+    """Compiles the simulator library for one build profile and returns its path.
+
+    sites: [(latitude, longitude)] of the tracker sites after site 0 (full build only).
+    The library is cached in the temporary directory by a hash of the sources.
+    """
+    defines = site_defines(sites)
+    digest = hashlib.sha1()
+    for path in SOURCES + HEADERS:
+        with open(path, "rb") as source:
+            digest.update(source.read())
+    digest.update(b"minimal" if minimal else b"full")
+    digest.update(" ".join(defines).encode())
+    out_dir = os.path.join(tempfile.gettempdir(), "attiny-clock-sim")
+    os.makedirs(out_dir, exist_ok=True)
+    library = os.path.join(out_dir, "clock-%s-%s.so" % ("minimal" if minimal else "full", digest.hexdigest()[:12]))
+    if not os.path.exists(library):
+        command = [cc, "-shared", "-fPIC", "-O1", "-std=gnu99", "-funsigned-char", "-w",
+                   "-I", os.path.join(SIM, "include"), "-I", SIM, "-I", FIRMWARE]
+        if minimal:
+            command.append("-DCLOCK_MINIMAL")
+        command += defines
+        subprocess.run(command + SOURCES + ["-lm", "-o", library + ".tmp"], check=True)
+        os.replace(library + ".tmp", library)
+    return library
+
+
+class Line:
+    """One line sent by the device, with device cycles and host (true) arrival times."""
+
+    def __init__(self, text, start_cycle, end_cycle, host_start, host_end):
+        self.text = text
+        self.start_cycle = start_cycle
+        self.end_cycle = end_cycle
+        self.host_start = host_start
+        self.host_end = host_end
+
+    def __repr__(self):
+        return "Line(%r, %.6f)" % (self.text, self.host_start)
+
+
+class Device:
+    """One simulated clock with a serial link to the host.
+
+    Every Device loads its own copy of the library, so firmware state is not shared.
+
+    drift_ppm: device crystal error, positive runs fast.
+    up_delay, down_delay: link latency host -> device and device -> host, seconds.
+    jitter: extra random latency per message, uniform 0..jitter seconds.
+    sites: [(latitude, longitude)] of the tracker sites after site 0, see build().
+    """
+
+    def __init__(self, minimal=False, drift_ppm=0.0, up_delay=0.0, down_delay=0.0, jitter=0.0, seed=1,
+                 costs=None, sites=()):
+        library = build(minimal, sites)
+        self._dir = tempfile.mkdtemp(prefix="clock-sim-")
+        private = os.path.join(self._dir, "clock.so")
+        shutil.copy(library, private)
+        self.lib = ctypes.CDLL(private)
+        self._declare()
+
+        self.info = SimFirmwareInfo()
+        self.lib.sim_firmwareInfo(ctypes.byref(self.info))
+        self.costs = SimCosts.in_dll(self.lib, "sim_costs")
+        for name, value in dict(COSTS["minimal" if self.info.minimal else "full"], **(costs or {})).items():
+            setattr(self.costs, name, value)
+
+        self.f_device = self.info.f_cpu * (1.0 + drift_ppm * 1e-6)
+        self.char_time = 10.0 / self.info.baud
+        self.up_delay = up_delay
+        self.down_delay = down_delay
+        self.jitter = jitter
+        self.random = random.Random(seed)
+
+        self.host_line_free = 0.0
+        self.rx_partial = None
+        self.lines = []
+        self.overflows = []
+        self.pulses = []
+        self.lib.sim_run(ctypes.c_uint64(0))
+
+    def _declare(self):
+        lib = self.lib
+        lib.sim_now.restype = ctypes.c_uint64
+        lib.sim_run.argtypes = [ctypes.c_uint64]
+        lib.sim_rx.argtypes = [ctypes.c_uint64, ctypes.c_uint8, ctypes.c_uint8]
+        lib.sim_pin.argtypes = [ctypes.c_uint64, ctypes.c_uint8, ctypes.c_uint8, ctypes.c_uint8]
+        lib.sim_txTake.argtypes = [ctypes.POINTER(SimTxChar), ctypes.c_uint32]
+        lib.sim_txTake.restype = ctypes.c_uint32
+        lib.sim_overflowTake.argtypes = [ctypes.POINTER(ctypes.c_uint64), ctypes.c_uint32]
+        lib.sim_overflowTake.restype = ctypes.c_uint32
+        lib.sim_pulseTake.argtypes = [ctypes.POINTER(SimPulse), ctypes.c_uint32]
+        lib.sim_pulseTake.restype = ctypes.c_uint32
+        lib.sim_txLost.restype = ctypes.c_uint32
+        lib.sim_deviceTimeOfDay.restype = ctypes.c_double
+
+    def close(self):
+        shutil.rmtree(self._dir, ignore_errors=True)
+
+    # Time conversion
+
+    def cycles(self, seconds):
+        return int(round(seconds * self.f_device))
+
+    def seconds(self, cycles):
+        return cycles / self.f_device
+
+    @property
+    def now(self):
+        """True (host) time in seconds since the start of the simulation."""
+        return self.seconds(self.lib.sim_now())
+
+    # Link
+
+    def _delay(self, base):
+        return base + (self.random.uniform(0.0, self.jitter) if self.jitter else 0.0)
+
+    def send(self, text, at=None, errors=None):
+        """Sends text to the device, the first byte leaves the host at time at (default now).
+
+        errors: optional {index: SIM_RX_FERR or SIM_RX_PERR} to damage single characters.
+        Returns the time the first byte left the host (later than at if the line was busy).
+        """
+        data = text.encode("latin-1") if isinstance(text, str) else bytes(text)
+        start = max(self.now if at is None else at, self.host_line_free)
+        arrival = start + self._delay(self.up_delay)
+        for i, byte in enumerate(data):
+            end = arrival + (i + 1) * self.char_time
+            self.lib.sim_rx(self.cycles(end), byte, (errors or {}).get(i, 0))
+        self.host_line_free = start + len(data) * self.char_time
+        return start
+
+    def set_pin(self, level, at=None):
+        """Drives the clock set input (low = time set commands accepted)."""
+        at = self.now if at is None else at
+        self.lib.sim_pin(self.cycles(at), self.info.set_port, self.info.set_pin_bm, 1 if level else 0)
+
+    # Running
+
+    def run(self, until):
+        """Runs the device until true time until (seconds), collecting its output."""
+        self.lib.sim_run(ctypes.c_uint64(self.cycles(until)))
+        self._collect()
+
+    def run_for(self, seconds):
+        self.run(self.now + seconds)
+
+    def _collect(self):
+        chars = (SimTxChar * 4096)()
+        while True:
+            count = self.lib.sim_txTake(chars, 4096)
+            for i in range(count):
+                self._receive(chars[i])
+            if count < 4096:
+                break
+        overflows = (ctypes.c_uint64 * 4096)()
+        while True:
+            count = self.lib.sim_overflowTake(overflows, 4096)
+            self.overflows.extend(overflows[i] for i in range(count))
+            if count < 4096:
+                break
+        pulses = (SimPulse * 4096)()
+        while True:
+            count = self.lib.sim_pulseTake(pulses, 4096)
+            self.pulses.extend((pulses[i].start, pulses[i].length) for i in range(count))
+            if count < 4096:
+                break
+
+    def _receive(self, char):
+        byte = char.data
+        if self.rx_partial is None:
+            if byte != ord("<"):
+                return
+            self.rx_partial = [bytearray(), char.start, self._delay(self.down_delay)]
+        self.rx_partial[0].append(byte)
+        if byte == ord("\n"):
+            data, start, delay = self.rx_partial
+            self.rx_partial = None
+            self.lines.append(Line(data.decode("latin-1").rstrip("\r\n"), start, char.end,
+                                   self.seconds(start) + delay, self.seconds(char.end) + delay))
+
+    def take_lines(self):
+        lines, self.lines = self.lines, []
+        return lines
+
+    def take_overflows(self):
+        overflows, self.overflows = self.overflows, []
+        return overflows
+
+    def take_pulses(self):
+        pulses, self.pulses = self.pulses, []
+        return pulses
+
+    @property
+    def tx_lost(self):
+        return self.lib.sim_txLost()
+
+    def time_of_day(self):
+        """Device local time of day in seconds, from its clock fields and RTC counter."""
+        return self.lib.sim_deviceTimeOfDay() / 1e6
+
+
+class SimLink:
+    """Transport for timesync.py over a simulated device.
+
+    The host clock is the true simulation time plus a time of day offset.
+    """
+
+    def __init__(self, device, tod_origin):
+        self.device = device
+        self.tod_origin = tod_origin
+        self.pending = []
+
+    def now(self):
+        return (self.tod_origin + self.device.now) % 86400.0
+
+    def write(self, text):
+        self.device.send(text)
+
+    def read_line(self, timeout=1.0):
+        deadline = self.device.now + timeout
+        while True:
+            if not self.pending:
+                self.pending = self.device.take_lines()
+            if self.pending:
+                line = self.pending.pop(0)
+                if line.host_end > self.device.now:
+                    self.device.run(line.host_end)
+                return line.text, (self.tod_origin + line.host_start) % 86400.0
+            if self.device.now >= deadline:
+                return None, None
+            self.device.run_for(0.001)
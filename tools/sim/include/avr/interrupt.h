@@ -0,0 +1,17 @@
+/*
+ * avr/interrupt.h for the host simulator
+ *
+ * Interrupt handlers are plain functions that the simulator calls, the global
+ * interrupt flag lives in the simulated SREG.
+ */
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+void sim_cli(void);
+void sim_sei(void);
+
+#define ISR(vector) void vector(void)
+#define cli() sim_cli()
+#define sei() sim_sei()
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
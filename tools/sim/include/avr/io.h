@@ -0,0 +1,227 @@
+/*
+ * avr/io.h for the host simulator
+ *
+ * Register model of the peripherals the clock firmware uses, bit values as in the
+ * ATtiny1604/ATtiny412 device headers. RTC, USART0, PORTA, PORTB and SREG are
+ * accessed through the simulator, which lets simulated time pass on every access,
+ * runs pending interrupts and applies the written values. The other peripherals are
+ * plain structures that the simulator reads when it needs them.
+ */
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Registers
+////////////////////////////////////////////////////////////////////////////////
+
+// Write-one-to-clear and write-to-act registers are 16 bits wide here: the simulator
+// sets bit 8 when it presents the register, a write clears it.
+typedef struct {
+	volatile uint8_t CTRLA;
+	volatile uint8_t STATUS;
+	volatile uint8_t INTCTRL;
+	volatile uint16_t INTFLAGS;
+	volatile uint8_t CLKSEL;
+	volatile uint16_t CNT;
+	volatile uint16_t PER;
+	volatile uint16_t CMP;
+} RTC_t;
+
+typedef struct {
+	volatile uint8_t RXDATAL;
+	volatile uint8_t RXDATAH;
+	volatile uint16_t TXDATAL;
+	volatile uint8_t TXDATAH;
+	volatile uint16_t STATUS;
+	volatile uint8_t CTRLA;
+	volatile uint8_t CTRLB;
+	volatile uint8_t CTRLC;
+	volatile uint16_t BAUD;
+} USART_t;
+
+typedef struct {
+	volatile uint8_t DIR;
+	volatile uint8_t DIRSET;
+	volatile uint8_t DIRCLR;
+	volatile uint8_t OUT;
+	volatile uint8_t OUTSET;
+	volatile uint8_t OUTCLR;
+	volatile uint8_t OUTTGL;
+	volatile uint8_t IN;
+	volatile uint8_t PIN0CTRL;
+	volatile uint8_t PIN1CTRL;
+	volatile uint8_t PIN2CTRL;
+	volatile uint8_t PIN3CTRL;
+	volatile uint8_t PIN4CTRL;
+	volatile uint8_t PIN5CTRL;
+	volatile uint8_t PIN6CTRL;
+	volatile uint8_t PIN7CTRL;
+} PORT_t;
+
+typedef struct {
+	volatile uint8_t CTRLA;
+	volatile uint8_t CTRLB;
+	volatile uint16_t PER;
+	volatile uint16_t CMP0;
+} TCA_SINGLE_t;
+
+typedef union {
+	TCA_SINGLE_t SINGLE;
+} TCA_t;
+
+typedef struct {
+	volatile uint8_t CTRLA;
+	volatile uint8_t CTRLB;
+	volatile uint8_t EVCTRL;
+	volatile uint8_t INTCTRL;
+	volatile uint8_t INTFLAGS;
+	volatile uint16_t CNT;
+	volatile uint16_t CCMP;
+} TCB_t;
+
+typedef struct {
+	volatile uint8_t ASYNCCH0;
+	volatile uint8_t ASYNCCH1;
+	volatile uint8_t ASYNCCH2;
+	volatile uint8_t ASYNCCH3;
+	volatile uint8_t SYNCCH0;
+	volatile uint8_t SYNCCH1;
+	volatile uint8_t ASYNCUSER0;
+	volatile uint8_t ASYNCUSER1;
+	volatile uint8_t ASYNCUSER2;
+	volatile uint8_t ASYNCUSER3;
+	volatile uint8_t ASYNCUSER4;
+	volatile uint8_t ASYNCUSER5;
+	volatile uint8_t ASYNCUSER6;
+	volatile uint8_t ASYNCUSER7;
+	volatile uint8_t ASYNCUSER8;
+	volatile uint8_t ASYNCUSER9;
+	volatile uint8_t ASYNCUSER10;
+	volatile uint8_t SYNCUSER0;
+	volatile uint8_t SYNCUSER1;
+} EVSYS_t;
+
+typedef struct {
+	volatile uint8_t CTRLA;
+	volatile uint8_t SEQCTRL0;
+	volatile uint8_t LUT0CTRLA;
+	volatile uint8_t LUT0CTRLB;
+	volatile uint8_t LUT0CTRLC;
+	volatile uint8_t TRUTH0;
+} CCL_t;
+
+typedef struct {
+	volatile uint8_t CTRLA;
+	volatile uint8_t CTRLB;
+	volatile uint8_t CTRLC;
+	volatile uint8_t CTRLD;
+} PORTMUX_t;
+
+typedef struct {
+	volatile uint8_t MCLKCTRLA;
+	volatile uint8_t MCLKCTRLB;
+	volatile uint8_t MCLKLOCK;
+	volatile uint8_t MCLKSTATUS;
+} CLKCTRL_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Simulator access
+////////////////////////////////////////////////////////////////////////////////
+
+RTC_t *sim_rtc(void);
+USART_t *sim_usart0(void);
+PORT_t *sim_port(uint8_t index);
+volatile uint8_t *sim_sreg(void);
+
+#define RTC (*sim_rtc())
+#define USART0 (*sim_usart0())
+#define PORTA (*sim_port(0))
+#define PORTB (*sim_port(1))
+#define SREG (*sim_sreg())
+
+extern TCA_t TCA0;
+extern TCB_t TCB0;
+extern EVSYS_t EVSYS;
+extern CCL_t CCL;
+extern PORTMUX_t PORTMUX;
+extern CLKCTRL_t CLKCTRL;
+extern volatile uint8_t CPU_CCP;
+
+////////////////////////////////////////////////////////////////////////////////
+// Bit masks and group configurations
+////////////////////////////////////////////////////////////////////////////////
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+
+#define CPU_I_bm 0x80
+#define CCP_IOREG_gc 0xD8
+
+#define CLKCTRL_CLKSEL_EXTCLK_gc 0x03
+#define CLKCTRL_PEN_bp 0
+#define CLKCTRL_PEN_bm 0x01
+#define CLKCTRL_SOSC_bm 0x01
+
+#define RTC_RTCEN_bm 0x01
+#define RTC_PRESCALER_gm 0x78
+#define RTC_PRESCALER_gp 3
+#define RTC_PRESCALER_DIV32_gc (0x05 << 3)
+#define RTC_CLKSEL_EXTCLK_gc 0x03
+#define RTC_OVF_bm 0x01
+#define RTC_OVF_bp 0
+#define RTC_CMP_bm 0x02
+#define RTC_CMP_bp 1
+#define RTC_CTRLABUSY_bm 0x01
+#define RTC_CNTBUSY_bm 0x02
+#define RTC_PERBUSY_bm 0x04
+
+#define USART_RXCIF_bm 0x80
+#define USART_TXCIF_bm 0x40
+#define USART_DREIF_bm 0x20
+#define USART_BUFOVF_bm 0x40
+#define USART_FERR_bm 0x04
+#define USART_PERR_bm 0x02
+#define USART_RXCIE_bm 0x80
+#define USART_TXCIE_bm 0x40
+#define USART_DREIE_bm 0x20
+#define USART_RXEN_bm 0x80
+#define USART_TXEN_bm 0x40
+#define USART_RXMODE_gm 0x06
+#define USART_RXMODE_CLK2X_gc 0x02
+#define USART_CMODE_ASYNCHRONOUS_gc 0x00
+#define USART_PMODE_DISABLED_gc 0x00
+#define USART_SBMODE_1BIT_gc 0x00
+#define USART_CHSIZE_8BIT_gc 0x03
+
+#define PORT_PULLUPEN_bm 0x08
+
+#define TCA_SINGLE_ENABLE_bm 0x01
+#define TCA_SINGLE_CLKSEL_DIV1024_gc (0x07 << 1)
+
+#define TCB_ENABLE_bm 0x01
+#define TCB_CLKSEL_CLKTCA_gc (0x02 << 1)
+#define TCB_CNTMODE_SINGLE_gc 0x06
+#define TCB_CCMPEN_bm 0x10
+#define TCB_CAPTEI_bm 0x01
+
+#define EVSYS_ASYNCCH0_RTC_OVF_gc 0x22
+#define EVSYS_ASYNCCH1_CCL_LUT0_gc 0x01
+#define EVSYS_ASYNCUSER0_OFF_gc 0x00
+#define EVSYS_ASYNCUSER0_ASYNCCH0_gc 0x03
+#define EVSYS_ASYNCUSER0_ASYNCCH1_gc 0x04
+
+#define CCL_ENABLE_bm 0x01
+#define CCL_OUTEN_bm 0x40
+#define CCL_INSEL0_TCB0_gc 0x0C
+
+#define PORTMUX_EVOUT0_bm 0x01
+
+#endif /* SIM_AVR_IO_H_ */
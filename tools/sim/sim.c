@@ -0,0 +1,588 @@
+/*
+ * sim.c
+ *
+ * Peripheral model and scheduler of the host simulator (see sim.h).
+ *
+ * The firmware main() runs in its own context. Every access to a modeled register,
+ * every charged cost and every main loop pass enters the simulator, which applies
+ * the values written since the last entry, lets time pass, runs the interrupt
+ * handlers that became due (when the I flag is set and no handler is running) and
+ * presents fresh register values. The host gets control back at the first main
+ * loop pass after the requested time.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "sim.h"
+
+#define NEVER UINT64_MAX
+#define SHOWN 0x100 // Bit 8 of a write-to-act register, cleared by a firmware write
+
+// Interrupt handlers of the firmware, in priority order (lowest vector number first)
+void RTC_CNT_vect(void);
+void USART0_RXC_vect(void);
+void USART0_DRE_vect(void);
+void USART0_TXC_vect(void);
+int firmware_main(void);
+
+enum { VECTOR_RTC, VECTOR_RXC, VECTOR_DRE, VECTOR_TXC, VECTOR_COUNT };
+
+static void (*const handlers[VECTOR_COUNT])(void) = {
+	RTC_CNT_vect, USART0_RXC_vect, USART0_DRE_vect, USART0_TXC_vect
+};
+
+// Cycles from the interrupt request to the first instruction of the handler
+#define ISR_ENTRY 12
+
+SimCosts sim_costs = {
+	.isr_rtc = 200,
+	.isr_rxc = 70,
+	.isr_dre = 50,
+	.isr_txc = 120,
+	.access = 1,
+	.loop = 40,
+	.frame = 90000,
+	.site = 25000,
+	.query = 70000,
+};
+
+// Peripherals without simulator access
+TCA_t TCA0;
+TCB_t TCB0;
+EVSYS_t EVSYS;
+CCL_t CCL;
+PORTMUX_t PORTMUX;
+CLKCTRL_t CLKCTRL;
+volatile uint8_t CPU_CCP;
+
+////////////////////////////////////////////////////////////////////////////////
+// State
+////////////////////////////////////////////////////////////////////////////////
+
+static sim_cycles_t now;
+static sim_cycles_t runUntil;
+static uint8_t inFirmware;  // Firmware context is running (not the host)
+static uint8_t inIsr;       // An interrupt handler is running
+static uint32_t activity;   // Main context entries and handlers since the last main loop pass
+static volatile uint8_t sreg;
+
+// Register images handed to the firmware, and the values they were presented with
+static RTC_t rtc, rtcShown;
+static USART_t usart, usartShown;
+static PORT_t ports[2], portsShown[2];
+
+// RTC counter: rtcBaseCount at rtcBaseCycle, counting while rtcRunning
+static uint8_t rtcRunning;
+static sim_cycles_t rtcBaseCycle;
+static uint32_t rtcBaseCount;
+static uint8_t rtcFlags;
+
+// USART0 transmitter: shift register and one buffered character
+static uint8_t txBusy, txData, txBufferFull, txBuffer, txComplete;
+static sim_cycles_t txStart, txEnd;
+static uint32_t txLost;
+
+// USART0 receiver: two level buffer and the shift register
+#define RX_DEPTH 3
+static struct { uint8_t data, flags; } rxFifo[RX_DEPTH];
+static uint8_t rxCount;
+
+static uint8_t pinLevel[2] = { 0xFF, 0xFF };
+
+// Host events, sorted by time
+enum { EVENT_RX, EVENT_PIN };
+typedef struct {
+	sim_cycles_t at;
+	uint8_t kind, data, flags, port, mask, level;
+} Event;
+
+typedef struct {
+	void *items;
+	uint32_t head, count, capacity;
+	size_t size;
+} Queue;
+
+static Queue events = { .size = sizeof(Event) };
+static Queue txLog = { .size = sizeof(SimTxChar) };
+static Queue overflowLog = { .size = sizeof(sim_cycles_t) };
+static Queue pulseLog = { .size = sizeof(SimPulse) };
+
+static ucontext_t hostContext, firmwareContext;
+static uint8_t started;
+
+////////////////////////////////////////////////////////////////////////////////
+// Queues
+////////////////////////////////////////////////////////////////////////////////
+
+static void *queueAt(Queue *queue, uint32_t index) {
+	return (char *)queue->items + (size_t)index * queue->size;
+}
+
+static void *queuePush(Queue *queue) {
+	if (queue->head > 0 && queue->head == queue->count) {
+		queue->head = queue->count = 0;
+	}
+	if (queue->count == queue->capacity) {
+		queue->capacity = queue->capacity ? queue->capacity * 2 : 256;
+		queue->items = realloc(queue->items, (size_t)queue->capacity * queue->size);
+		if (queue->items == NULL) {
+			abort();
+		}
+	}
+	return queueAt(queue, queue->count++);
+}
+
+static uint32_t queueTake(Queue *queue, void *out, uint32_t max) {
+	uint32_t count = queue->count - queue->head;
+	if (count > max) {
+		count = max;
+	}
+	memcpy(out, queueAt(queue, queue->head), (size_t)count * queue->size);
+	queue->head += count;
+	return count;
+}
+
+static void eventInsert(const Event *event) {
+	Event *slot = queuePush(&events);
+	uint32_t i = events.count - 1;
+
+	// Host events mostly arrive in order, insert from the end
+	while (i > events.head && ((Event *)queueAt(&events, i - 1))->at > event->at) {
+		*(Event *)queueAt(&events, i) = *(Event *)queueAt(&events, i - 1);
+		i--;
+	}
+	slot = queueAt(&events, i);
+	*slot = *event;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Peripheral model
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t rtcPrescaler(uint8_t ctrla) {
+	return 1u << ((ctrla & RTC_PRESCALER_gm) >> RTC_PRESCALER_gp);
+}
+
+static uint32_t rtcCountAt(sim_cycles_t at) {
+	if (!rtcRunning) {
+		return rtcBaseCount;
+	}
+	return rtcBaseCount + (uint32_t)((at - rtcBaseCycle) / rtcPrescaler(rtc.CTRLA));
+}
+
+static sim_cycles_t rtcOverflowAt(void) {
+	if (!rtcRunning) {
+		return NEVER;
+	}
+	uint32_t limit = (rtcBaseCount <= rtc.PER) ? (uint32_t)rtc.PER + 1 : 0x10000;
+	return rtcBaseCycle + (sim_cycles_t)(limit - rtcBaseCount) * rtcPrescaler(rtc.CTRLA);
+}
+
+static void rtcOverflow(sim_cycles_t at) {
+	rtcFlags |= RTC_OVF_bm;
+	rtcBaseCount = 0;
+	rtcBaseCycle = at;
+	*(sim_cycles_t *)queuePush(&overflowLog) = at;
+
+	// RTC_OVF -> ASYNCCH0 -> TCB0 capture event input, single-shot pulse
+	if (EVSYS.ASYNCCH0 == EVSYS_ASYNCCH0_RTC_OVF_gc && EVSYS.ASYNCUSER0 == EVSYS_ASYNCUSER0_ASYNCCH0_gc
+	    && (TCB0.CTRLA & TCB_ENABLE_bm) && (TCB0.EVCTRL & TCB_CAPTEI_bm)) {
+		SimPulse *pulse = queuePush(&pulseLog);
+		pulse->start = at;
+		pulse->length = TCB0.CCMP * (((TCB0.CTRLA & 0x06) == TCB_CLKSEL_CLKTCA_gc) ? 1024 : 1);
+	}
+}
+
+static sim_cycles_t usartCharCycles(void) {
+	uint32_t samples = ((usart.CTRLB & USART_RXMODE_gm) == USART_RXMODE_CLK2X_gc) ? 8 : 16;
+	uint32_t baud = usart.BAUD < 64 ? 64 : usart.BAUD;
+
+	// 8N1: start, 8 data and stop bit
+	return 10 * (sim_cycles_t)samples * baud / 64;
+}
+
+static void usartTransmit(uint8_t data) {
+	if (!(usart.CTRLB & USART_TXEN_bm)) {
+		return;
+	}
+	if (!txBusy) {
+		txBusy = 1;
+		txData = data;
+		txStart = now;
+		txEnd = now + usartCharCycles();
+	}
+	else if (!txBufferFull) {
+		txBufferFull = 1;
+		txBuffer = data;
+	}
+	else {
+		txLost++;
+	}
+}
+
+static void usartTxEnd(void) {
+	SimTxChar *entry = queuePush(&txLog);
+	entry->start = txStart;
+	entry->end = txEnd;
+	entry->data = txData;
+
+	if (txBufferFull) {
+		txBufferFull = 0;
+		txData = txBuffer;
+		txStart = txEnd;
+		txEnd += usartCharCycles();
+	}
+	else {
+		txBusy = 0;
+		txComplete = 1;
+	}
+}
+
+static void hostEvent(const Event *event) {
+	if (event->kind == EVENT_RX) {
+		if (!(usart.CTRLB & USART_RXEN_bm)) {
+			return;
+		}
+		if (rxCount < RX_DEPTH) {
+			rxFifo[rxCount].data = event->data;
+			rxFifo[rxCount].flags = event->flags;
+			rxCount++;
+		}
+		else {
+			rxFifo[RX_DEPTH - 1].flags |= USART_BUFOVF_bm;
+		}
+	}
+	else if (event->level) {
+		pinLevel[event->port] |= event->mask;
+	}
+	else {
+		pinLevel[event->port] &= ~event->mask;
+	}
+}
+
+static sim_cycles_t nextEvent(void) {
+	sim_cycles_t next = rtcOverflowAt();
+
+	if (txBusy && txEnd < next) {
+		next = txEnd;
+	}
+	if (events.head < events.count && ((Event *)queueAt(&events, events.head))->at < next) {
+		next = ((Event *)queueAt(&events, events.head))->at;
+	}
+	return next;
+}
+
+// Lets the hardware run until the given time, no interrupt handlers run here
+static void advanceTo(sim_cycles_t until) {
+	for (;;) {
+		sim_cycles_t overflow = rtcOverflowAt();
+		sim_cycles_t next = nextEvent();
+		if (next > until) {
+			break;
+		}
+		if (next > now) {
+			now = next;
+		}
+		if (overflow == next) {
+			rtcOverflow(overflow);
+		}
+		else if (txBusy && txEnd == next) {
+			usartTxEnd();
+		}
+		else {
+			hostEvent(queueAt(&events, events.head++));
+		}
+	}
+	if (until > now) {
+		now = until;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Register access
+////////////////////////////////////////////////////////////////////////////////
+
+// Applies what the firmware wrote into the register images since the last entry
+static void commit(void) {
+	if (rtc.CTRLA != rtcShown.CTRLA) {
+		uint8_t enable = rtc.CTRLA & RTC_RTCEN_bm;
+		uint8_t ctrla = rtc.CTRLA;
+
+		// Rebase with the old prescaler before it changes
+		rtc.CTRLA = rtcShown.CTRLA;
+		rtcBaseCount = rtcCountAt(now);
+		rtc.CTRLA = ctrla;
+		rtcBaseCycle = now;
+		rtcRunning = enable;
+	}
+	if (rtc.CNT != rtcShown.CNT) {
+		rtcBaseCount = rtc.CNT;
+		rtcBaseCycle = now;
+	}
+	if (!(rtc.INTFLAGS & SHOWN)) {
+		rtcFlags &= ~rtc.INTFLAGS;
+	}
+
+	if (!(usart.STATUS & SHOWN) && (usart.STATUS & USART_TXCIF_bm)) {
+		txComplete = 0;
+	}
+	if (!(usart.TXDATAL & SHOWN)) {
+		usartTransmit(usart.TXDATAL);
+	}
+}
+
+// Refreshes the register images for the firmware
+static void present(void) {
+	rtc.CNT = rtcCountAt(now);
+	rtc.INTFLAGS = SHOWN | rtcFlags;
+	rtc.STATUS = 0;
+	rtcShown = rtc;
+
+	usart.STATUS = SHOWN | (rxCount ? USART_RXCIF_bm : 0) | (txComplete ? USART_TXCIF_bm : 0)
+	               | (txBufferFull ? 0 : USART_DREIF_bm);
+	usart.RXDATAL = rxCount ? rxFifo[0].data : 0;
+	usart.RXDATAH = rxCount ? (USART_RXCIF_bm | rxFifo[0].flags) : 0;
+	usart.TXDATAL = SHOWN;
+	usartShown = usart;
+
+	for (uint8_t i = 0; i < 2; i++) {
+		ports[i].IN = pinLevel[i];
+		portsShown[i] = ports[i];
+	}
+	CLKCTRL.MCLKSTATUS = 0;
+}
+
+static int pendingVector(void) {
+	if ((rtc.INTCTRL & RTC_OVF_bm) && (rtcFlags & RTC_OVF_bm)) {
+		return VECTOR_RTC;
+	}
+	if ((usart.CTRLA & USART_RXCIE_bm) && rxCount > 0) {
+		return VECTOR_RXC;
+	}
+	if ((usart.CTRLA & USART_DREIE_bm) && !txBufferFull) {
+		return VECTOR_DRE;
+	}
+	if ((usart.CTRLA & USART_TXCIE_bm) && txComplete) {
+		return VECTOR_TXC;
+	}
+	return -1;
+}
+
+static uint32_t isrCost(int vector) {
+	switch (vector) {
+	case VECTOR_RTC: return sim_costs.isr_rtc;
+	case VECTOR_RXC: return sim_costs.isr_rxc;
+	case VECTOR_DRE: return sim_costs.isr_dre;
+	default: return sim_costs.isr_txc;
+	}
+}
+
+// Runs the interrupt handlers that are due, one after the other (level 0 does not nest)
+static void dispatch(void) {
+	if (!inFirmware || inIsr || !(sreg & CPU_I_bm)) {
+		return;
+	}
+	for (;;) {
+		int vector = pendingVector();
+		if (vector < 0) {
+			return;
+		}
+		uint32_t cost = isrCost(vector);
+		uint32_t entry = cost < ISR_ENTRY ? cost : ISR_ENTRY;
+
+		inIsr = 1;
+		activity++;
+		advanceTo(now + entry);
+		present();
+		handlers[vector]();
+		commit();
+
+		// The receive handler reads RXDATAL once, which takes the character out of the buffer
+		if (vector == VECTOR_RXC && rxCount > 0) {
+			memmove(&rxFifo[0], &rxFifo[1], sizeof(rxFifo[0]) * (RX_DEPTH - 1));
+			rxCount--;
+		}
+		advanceTo(now + cost - entry);
+		present();
+		inIsr = 0;
+	}
+}
+
+// Time passes in the running context, handlers interrupt the main context as they become due
+static void step(uint32_t cycles) {
+	if (inIsr) {
+		advanceTo(now + cycles);
+		return;
+	}
+	advanceTo(now);
+	dispatch();
+	while (cycles > 0) {
+		sim_cycles_t next = nextEvent();
+		uint32_t part = (next > now && next - now < cycles) ? (uint32_t)(next - now) : cycles;
+		advanceTo(now + part);
+		cycles -= part;
+		dispatch();
+	}
+}
+
+static void enter(void) {
+	commit();
+	if (inFirmware) {
+		if (!inIsr) {
+			activity++;
+		}
+		step(sim_costs.access);
+	}
+	present();
+}
+
+RTC_t *sim_rtc(void) {
+	enter();
+	return &rtc;
+}
+
+USART_t *sim_usart0(void) {
+	enter();
+	return &usart;
+}
+
+PORT_t *sim_port(uint8_t index) {
+	enter();
+	return &ports[index];
+}
+
+volatile uint8_t *sim_sreg(void) {
+	enter();
+	return &sreg;
+}
+
+void sim_cli(void) {
+	commit();
+	sreg &= ~CPU_I_bm;
+}
+
+void sim_sei(void) {
+	commit();
+	sreg |= CPU_I_bm;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Firmware hooks
+////////////////////////////////////////////////////////////////////////////////
+
+void sim_charge(uint32_t cycles) {
+	commit();
+	if (!inIsr) {
+		activity++;
+	}
+	step(cycles);
+	present();
+}
+
+// Waits for the next hardware or host event (busy waits of the firmware on RAM variables)
+void sim_idle(void) {
+	commit();
+	sim_cycles_t next = nextEvent();
+	if (next == NEVER || next <= now) {
+		next = now + sim_costs.loop;
+	}
+	advanceTo(next);
+	dispatch();
+	present();
+}
+
+void sim_loopBegin(void) {
+	uint32_t busy = activity;
+
+	commit();
+	activity = 0;
+	if (busy) {
+		step(sim_costs.loop);
+	}
+	else {
+		// Nothing happened in the last pass, nothing will until the next event
+		sim_cycles_t next = nextEvent();
+		if (next > runUntil) {
+			next = runUntil;
+		}
+		if (next <= now) {
+			next = now + sim_costs.loop;
+		}
+		advanceTo(next);
+		dispatch();
+	}
+	if (now >= runUntil) {
+		inFirmware = 0;
+		swapcontext(&firmwareContext, &hostContext);
+		inFirmware = 1;
+	}
+	present();
+}
+
+uint16_t sim_rtcCount(uint8_t *overflowPending) {
+	*overflowPending = (rtcFlags & RTC_OVF_bm) != 0;
+	return rtcCountAt(now);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Host interface
+////////////////////////////////////////////////////////////////////////////////
+
+static void firmwareEntry(void) {
+	firmware_main();
+}
+
+sim_cycles_t sim_now(void) {
+	return now;
+}
+
+void sim_run(sim_cycles_t until) {
+	runUntil = until;
+	if (!started) {
+		static char stack[1 << 20];
+		started = 1;
+		present();
+		getcontext(&firmwareContext);
+		firmwareContext.uc_stack.ss_sp = stack;
+		firmwareContext.uc_stack.ss_size = sizeof(stack);
+		firmwareContext.uc_link = &hostContext;
+		makecontext(&firmwareContext, firmwareEntry, 0);
+	}
+	inFirmware = 1;
+	swapcontext(&hostContext, &firmwareContext);
+	inFirmware = 0;
+}
+
+int sim_rx(sim_cycles_t end, uint8_t data, uint8_t flags) {
+	Event event = { .at = end < now ? now : end, .kind = EVENT_RX, .data = data, .flags = flags };
+	eventInsert(&event);
+	return 0;
+}
+
+int sim_pin(sim_cycles_t at, uint8_t port, uint8_t mask, uint8_t level) {
+	if (port > 1) {
+		return -1;
+	}
+	Event event = { .at = at < now ? now : at, .kind = EVENT_PIN, .port = port, .mask = mask, .level = level };
+	eventInsert(&event);
+	return 0;
+}
+
+uint32_t sim_txTake(SimTxChar *out, uint32_t max) {
+	return queueTake(&txLog, out, max);
+}
+
+uint32_t sim_overflowTake(sim_cycles_t *out, uint32_t max) {
+	return queueTake(&overflowLog, out, max);
+}
+
+uint32_t sim_pulseTake(SimPulse *out, uint32_t max) {
+	return queueTake(&pulseLog, out, max);
+}
+
+uint32_t sim_txLost(void) {
+	return txLost;
+}
@@ -0,0 +1,85 @@
+/*
+ * sim.h
+ *
+ * Host simulator of the clock: the firmware sources run unchanged on the host, the
+ * peripherals it touches are modeled in sim.c. Time is counted in CPU cycles of the
+ * device (F_CPU). Code between two register accesses takes no time, the costs of the
+ * interrupt handlers, of a main loop pass and of the solar position calculations are
+ * charged from sim_costs instead. They are estimates, not measurements of the AVR code.
+ *
+ * Used from Python through ctypes, see tools/avrsim.py.
+ */
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+
+typedef uint64_t sim_cycles_t;
+
+// Modeled costs in CPU cycles, including interrupt entry and exit
+typedef struct {
+	uint32_t isr_rtc;       // RTC overflow: tick advance, frame swap, heartbeat arming
+	uint32_t isr_rxc;       // one received character
+	uint32_t isr_dre;       // one transmitted character
+	uint32_t isr_txc;       // end of a frame, latency statistics
+	uint32_t access;        // one peripheral register access
+	uint32_t loop;          // one pass of the main loop without work
+	uint32_t frame;         // solar position and formatting of a frame with site 0
+	uint32_t site;          // each further site of a frame: position from the shared terms and formatting
+	uint32_t query;         // one solar position of a query answer
+} SimCosts;
+
+extern SimCosts sim_costs;
+
+// Firmware build parameters, for the Python side
+typedef struct {
+	uint32_t f_cpu;
+	uint32_t baud;
+	uint16_t ticks_per_second;
+	uint16_t rtc_tick_counts;
+	uint8_t frame_slots;
+	uint8_t minimal;
+	uint8_t set_port;       // 0 = PORTA, 1 = PORTB
+	uint8_t set_pin_bm;
+	uint16_t latency_bin_counts;
+	uint8_t latency_bins;
+	uint8_t command_size;
+	uint8_t site_count;
+} SimFirmwareInfo;
+
+// One character on the device TX line, start of the start bit to end of the stop bit
+typedef struct {
+	sim_cycles_t start;
+	sim_cycles_t end;
+	uint8_t data;
+} SimTxChar;
+
+// One heartbeat pulse started by the TCB0 event input
+typedef struct {
+	sim_cycles_t start;
+	uint32_t length;
+} SimPulse;
+
+// Error flags of an injected receive character, as in RXDATAH
+#define SIM_RX_FERR 0x04
+#define SIM_RX_PERR 0x02
+
+// Simulator control, called from the host
+void sim_firmwareInfo(SimFirmwareInfo *info);
+sim_cycles_t sim_now(void);
+void sim_run(sim_cycles_t until);
+int sim_rx(sim_cycles_t end, uint8_t data, uint8_t flags);
+int sim_pin(sim_cycles_t at, uint8_t port, uint8_t mask, uint8_t level);
+uint32_t sim_txTake(SimTxChar *out, uint32_t max);
+uint32_t sim_overflowTake(sim_cycles_t *out, uint32_t max);
+uint32_t sim_pulseTake(SimPulse *out, uint32_t max);
+uint32_t sim_txLost(void);
+double sim_deviceTimeOfDay(void);
+
+// Hooks for the firmware wrappers
+void sim_charge(uint32_t cycles);
+void sim_idle(void);
+void sim_loopBegin(void);
+uint16_t sim_rtcCount(uint8_t *overflowPending);
+
+#endif /* SIM_H_ */
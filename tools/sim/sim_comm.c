@@ -0,0 +1,12 @@
+/*
+ * sim_comm.c
+ *
+ * Communications.c for the simulator, with the query position calculation charged
+ * its modeled cost (see sim_main.c).
+ */
+#include "Settings.h"
+
+void sim_calculateSolarPositionAt(volatile SolarPositionParameters *params);
+
+#define calculate_solar_position_at sim_calculateSolarPositionAt
+#include "Communications.c"
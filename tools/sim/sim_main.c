@@ -0,0 +1,73 @@
+/*
+ * sim_main.c
+ *
+ * main() of the firmware with the simulator hooks: every main loop pass enters the
+ * simulator, and the frame preparation is charged its modeled cost for the configured sites.
+ */
+#include "Settings.h"
+#include "sim.h"
+
+void sim_mainLoop(void);
+
+#define main firmware_main
+#define RTC_prepareFrame sim_mainLoop
+#include "main.c"
+#undef RTC_prepareFrame
+#undef main
+
+void sim_mainLoop(void) {
+	sim_loopBegin();
+
+	// RTC_prepareFrame() works only when a tick is pending and (one slot) the slot is free
+	if (tickPending && !(FRAME_SLOTS == 1 && USART0_frameSending())) {
+		sim_charge(sim_costs.frame + (SOLAR_SITE_COUNT - 1) * sim_costs.site);
+	}
+	RTC_prepareFrame();
+}
+
+/**
+ * @brief Query answers go through here, so the position calculation is charged its modeled cost.
+ */
+void sim_calculateSolarPositionAt(volatile SolarPositionParameters *params) {
+	sim_charge(sim_costs.query);
+	calculate_solar_position_at(params);
+}
+
+void sim_firmwareInfo(SimFirmwareInfo *info) {
+	info->f_cpu = F_CPU;
+	info->baud = USART0_BAUD;
+	info->ticks_per_second = TICKS_PER_SECOND;
+	info->rtc_tick_counts = RTC_TICK_COUNTS;
+	info->frame_slots = FRAME_SLOTS;
+#ifdef CLOCK_MINIMAL
+	info->minimal = 1;
+	info->set_port = 0;
+#else
+	info->minimal = 0;
+	info->set_port = 1;
+#endif
+	info->set_pin_bm = SET_PIN_bm;
+	info->latency_bin_counts = LATENCY_BIN_COUNTS;
+	info->latency_bins = LATENCY_BINS;
+	info->command_size = COMMAND_SIZE;
+	info->site_count = SOLAR_SITE_COUNT;
+}
+
+/**
+ * @brief Local time of day of the device clock in microseconds, from solar_params and the RTC counter.
+ * 
+ * Valid between two main loop passes, when no interrupt handler is halfway through a tick.
+ */
+double sim_deviceTimeOfDay(void) {
+	uint8_t pending;
+	uint16_t count = sim_rtcCount(&pending);
+	double micros = ((solar_params.hour * 60.0 + solar_params.minute) * 60.0 + solar_params.second) * 1e6
+	                + solar_params.hundreds * (1e6 / TICKS_PER_SECOND)
+	                + count * (32e6 / F_CPU);
+
+	// An overflow whose handler has not run yet already started the next tick
+	if (pending) {
+		micros += 1e6 / TICKS_PER_SECOND;
+	}
+	return micros;
+}
@@ -0,0 +1,31 @@
+/*
+ * sim_usart.c
+ *
+ * USART.c for the simulator. The host C library has no avr-libc stream setup, and the
+ * busy wait of USART0_frameHold() reads only RAM, so simulated time is let pass until
+ * the frame on the wire is done before the firmware version runs.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include "sim.h"
+
+#undef stdout
+#define stdout sim_stdout
+#define FDEV_SETUP_STREAM(put, get, flags) { 0 }
+#define _FDEV_SETUP_WRITE 0
+
+FILE *sim_stdout;
+
+#define USART0_frameHold USART0_frameHold_firmware
+#include "USART.c"
+#undef USART0_frameHold
+
+void USART0_frameHold(uint8_t hold) {
+	if (hold) {
+		frameHeld = 1;
+		while (frameTx != NULL) {
+			sim_idle();
+		}
+	}
+	USART0_frameHold_firmware(hold);
+}
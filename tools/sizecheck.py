@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Flash and RAM budget check of a build, run as the post-build step of the Minimal configuration.
+
+    python3 sizecheck.py --size avr-size --flash 4096 --ram 256 --stack 64 clock.elf [*.o ...]
+
+Reads the sections of the .elf with `avr-size -A` and fails (exit code 1) if
+
+    flash = .text + .rodata + .data (initial values)  > --flash
+    RAM   = .data + .bss + .noinit                     > --ram - --stack
+
+A .rodata section at a data space address (0x800000 and up) is copied to RAM by the
+startup code and counts against RAM as well. The check does not depend on the region
+lengths of the linker script.
+
+Objects given after the .elf are listed per module as a Markdown table (text, rodata,
+data and bss bytes), the format of the table in the README. Patterns like *.o are
+expanded here, so the step also works from cmd.exe.
+"""
+
+import argparse
+import glob
+import os
+import subprocess
+import sys
+
+DATA_SPACE = 0x800000
+
+GROUPS = (".text", ".rodata", ".data", ".bss", ".noinit")
+
+
+def sections(size, path):
+    """Returns [(name, size, address)] of the sections avr-size -A lists for path."""
+    output = subprocess.run([size, "-A", path], check=True, stdout=subprocess.PIPE,
+                            universal_newlines=True).stdout
+    result = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[0].startswith(".") and fields[1].isdigit():
+            result.append((fields[0], int(fields[1]), int(fields[2], 0)))
+    return result
+
+
+def group(name):
+    """Output section group of an input or output section name, None for debug and notes."""
+    for prefix in GROUPS:
+        if name == prefix or name.startswith(prefix + "."):
+            return prefix
+    return None
+
+
+def budget(elf_sections):
+    flash = ram = 0
+    for name, length, address in elf_sections:
+        kind = group(name)
+        if kind in (".text", ".rodata", ".data"):
+            flash += length
+        if kind in (".data", ".bss", ".noinit") or (kind == ".rodata" and address >= DATA_SPACE):
+            ram += length
+    return flash, ram
+
+
+def modules(size, paths):
+    rows = []
+    for path in paths:
+        totals = dict.fromkeys(GROUPS, 0)
+        for name, length, _ in sections(size, path):
+            kind = group(name)
+            if kind is not None:
+                totals[kind] += length
+        rows.append((os.path.basename(path), totals))
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--size", default="avr-size", help="avr-size executable")
+    parser.add_argument("--flash", type=int, required=True, help="flash of the device, bytes")
+    parser.add_argument("--ram", type=int, required=True, help="RAM of the device, bytes")
+    parser.add_argument("--stack", type=int, default=64, help="RAM kept free for the stack, bytes")
+    parser.add_argument("elf")
+    parser.add_argument("objects", nargs="*", help="object files for the per module table")
+    args = parser.parse_args()
+
+    objects = []
+    for pattern in args.objects:
+        objects.extend(sorted(glob.glob(pattern)) or [pattern])
+    if objects:
+        print("| Module | .text | .rodata | .data | .bss |")
+        print("|---|---|---|---|---|")
+        for name, totals in modules(args.size, objects):
+            print("| %s | %d | %d | %d | %d |" % (name, totals[".text"], totals[".rodata"], totals[".data"],
+                                                  totals[".bss"] + totals[".noinit"]))
+
+    flash, ram = budget(sections(args.size, args.elf))
+    ram_limit = args.ram - args.stack
+    print("%s: flash %d of %d bytes, static RAM %d of %d bytes (%d kept for the stack)" % (
+        os.path.basename(args.elf), flash, args.flash, ram, ram_limit, args.stack))
+    failed = False
+    if flash > args.flash:
+        print("error: flash over budget by %d bytes" % (flash - args.flash))
+        failed = True
+    if ram > ram_limit:
+        print("error: static RAM over budget by %d bytes" % (ram - ram_limit))
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,445 @@
+#!/usr/bin/env python3
+"""Soak run of the clock firmware on the simulator (see avrsim.py).
+
+    python3 soak.py [--minimal] [--seconds 60] [--seed 1] [--poll 1800]
+
+The default 60 s is a quick smoke run. The gating run is two hours, which is longer
+than the 16 bit device counters last:
+
+    python3 soak.py --seconds 7200 [--minimal]
+
+Sends random valid and malformed commands at random moments, toggles the clock set
+input (PB1, PA1 in the minimal build) and captures everything the device sends. At the
+end it checks that:
+
+- every frame carries the time of the tick that sent it: no lost or repeated ticks
+- ticks with the set input high that sent no frame match the device's missed counter
+- every valid command is answered
+- the device counters agree with what the host saw and sent. They are read and cleared
+  with <D|1> every --poll seconds and added up on the host, as the README says to do.
+- the frame latency, from the RTC overflow to the last stop bit, stays within the limits
+
+The exit code is nonzero if a check fails. Latencies follow from the modeled costs in
+avrsim.COSTS, so they show the effect of code changes, not the exact AVR timing.
+"""
+
+import argparse
+import bisect
+import datetime
+import random
+import sys
+
+import avrsim
+
+EPOCH = datetime.datetime(2025, 6, 21)
+
+# Host time of day at the start, close to midnight so the run crosses a date change
+START_TOD = 86400 - 20
+
+# Query answers wait for the frame of the tick and one position calculation
+REPLY_TIMEOUT = 0.1
+
+# Tracker sites 1 and up of a multi-site run (--sites), latitude and longitude
+SITES = [(54.8985, 23.9036), (-33.8688, 151.2093), (64.1466, -21.9426), (0.0, -78.5), (-54.8, -68.3)]
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+class Soak:
+    def __init__(self, minimal, seed, sites=1):
+        self.device = avrsim.Device(minimal=minimal, seed=seed, sites=SITES[:sites - 1])
+        self.info = self.device.info
+        self.sites = self.info.site_count
+        self.ticks = self.info.ticks_per_second
+        self.digits = 2 if self.ticks > 10 else 1
+        self.random = random.Random(seed)
+        self.origin_tick = START_TOD * self.ticks
+
+        self.lines = []
+        self.scan = 0
+        self.overflows = []
+        self.low = []             # intervals of host time with the set input low
+        self.expected = dict(invalid=0, dropped=0, errors=0)
+        self.sent = dict(valid=0, invalid=0, ignored=0, dropped=0, errors=0, time_set=0, set_low=0)
+        self.query_latency = []   # (host seconds, device counts)
+        self.sweep_latency = []   # (phase in the tick, host seconds, device counts)
+        self.failures = []
+        # Sums of the <D|1> snapshots, None once a poll goes unanswered
+        self.totals = dict(frames=0, missed=0, latency_min=0xFFFF, latency_max=0, histogram=[0] * self.info.latency_bins,
+                           dropped=0, invalid=0, errors=0, polls=0)
+
+    # Link
+
+    def pump(self, until):
+        self.device.run(until)
+        self.lines.extend(self.device.take_lines())
+        self.overflows.extend(self.device.take_overflows())
+
+    def boundary(self, ahead):
+        """Host time of a tick boundary, ahead ticks after the current tick."""
+        return (int(self.device.now * self.ticks) + ahead) / self.ticks
+
+    def send(self, text, at=None, errors=None):
+        """Sends text, returns the host time its last stop bit arrives."""
+        start = self.device.send(text, at=at, errors=errors)
+        return start + len(text) * self.device.char_time
+
+    def send_mid_tick(self, text):
+        """Sends text so it ends in the middle of a tick, when no frame is on the wire."""
+        end = self.boundary(2) + 0.5 / self.ticks
+        return self.send(text, at=end - len(text) * self.device.char_time)
+
+    def await_line(self, prefix, deadline):
+        while True:
+            while self.scan < len(self.lines):
+                line = self.lines[self.scan]
+                self.scan += 1
+                if line.text.startswith(prefix):
+                    return line
+            if self.device.now >= deadline:
+                return None
+            self.pump(self.device.now + 0.001)
+
+    def expect_reply(self, command, prefix, end):
+        """Waits for the answer to a command whose last stop bit arrives at host time end."""
+        line = self.await_line(prefix, end + REPLY_TIMEOUT)
+        if line is None:
+            self.failures.append("no answer to <%s> at %.3f s" % (command, self.device.now))
+        return line
+
+    # Commands
+
+    def tick_text(self, tick):
+        """YYYYMMDDhhmmsstt of a host tick (counted from the start of the run)."""
+        seconds, tick = divmod(self.origin_tick + tick, self.ticks)
+        stamp = EPOCH + datetime.timedelta(seconds=seconds)
+        return stamp.strftime("%Y%m%d%H%M%S") + "%0*d" % (self.digits, tick)
+
+    def random_date(self):
+        r = self.random
+        year = r.randint(2000, 2099)
+        month = r.randint(1, 12)
+        days = (datetime.date(year + month // 12, month % 12 + 1, 1) - datetime.timedelta(days=1)).day
+        return "%04d%02d%02d%02d%02d%02d%0*d" % (year, month, r.randint(1, days), r.randint(0, 23),
+                                                 r.randint(0, 59), r.randint(0, 59),
+                                                 self.digits, r.randrange(self.ticks))
+
+    def valid_command(self):
+        r = self.random
+        kind = r.choice(["D", "S", "O", "L", "Q", "Q"])
+        if kind == "D":
+            return "D|0", "<R|"
+        if kind == "S":
+            stamp = "%05d.%06d" % (r.randrange(86400), r.randrange(1000000))
+            return "S|" + stamp, "<T|%s|" % stamp
+        if kind == "O":
+            return "O|0", "<A|0>"
+        if kind == "L":
+            return "L|2", None
+        query = self.random_date()
+        if r.random() < 0.5:
+            return "Q|" + query, "<P|%s|0|" % query
+        site = r.randrange(self.sites)
+        return "Q|%s|%d" % (query, site), "<P|%s|%d|" % (query, site)
+
+    def invalid_command(self):
+        r = self.random
+        tick = "0" * self.digits
+        commands = [
+            "X|1", "", "S", "D|7", "L|9", "O|2000000", "Q|", "Q|20250621", "Q|20250621120000" + tick + "0",
+            "Q|20251301000000" + tick, "Q|20250001000000" + tick, "Q|20250229120000" + tick,
+            "Q|20250621250000" + tick, "Q|20250621120000%d" % self.ticks, "Q|20250621120000" + tick + "|7",
+            "Q|20250621120000" + tick + "|0x", "Q|20250621120000" + tick + "|%d" % self.sites,
+        ]
+        if self.info.minimal:
+            # Outside the years of the fixed point model
+            commands += ["Q|19991231120000" + tick, "Q|21000101120000" + tick, "Q|99991231120000" + tick]
+        return r.choice(commands)
+
+    def one_command(self):
+        r = self.random
+        choice = r.random()
+        if choice < 0.55:
+            command, prefix = self.valid_command()
+            end = self.send("<%s>" % command)
+            self.sent["valid"] += 1
+            if prefix is None:
+                self.pump(self.device.now + 0.01)
+                return
+            line = self.expect_reply(command, prefix, end)
+            if line is not None and command.startswith("Q|"):
+                fields = line.text[1:-1].split("|")
+                self.query_latency.append((line.host_start - end, int(fields[-1])))
+        elif choice < 0.75:
+            self.send("<%s>" % self.invalid_command())
+            self.expected["invalid"] += 1
+            self.sent["invalid"] += 1
+            self.pump(self.device.now + 0.01)
+        elif choice < 0.82:
+            # Time set with the set input high, and answers of other clocks: ignored
+            text = r.choice([self.tick_text(0), "T|00000.000000|1|2", "A|5", "R|1|2"])
+            self.send("<%s>" % text)
+            self.sent["ignored"] += 1
+            self.pump(self.device.now + 0.01)
+        elif choice < 0.88:
+            self.send("<" + "9" * (self.info.command_size + r.randint(0, 20)) + ">")
+            self.expected["dropped"] += 1
+            self.sent["dropped"] += 1
+            self.pump(self.device.now + 0.01)
+        elif choice < 0.95:
+            text = "<D|0>"
+            self.send(text, errors={r.randrange(len(text)): r.choice([avrsim.SIM_RX_FERR, avrsim.SIM_RX_PERR])})
+            self.expected["errors"] += 1
+            self.sent["errors"] += 1
+            self.pump(self.device.now + 0.01)
+        else:
+            # Line noise between commands
+            self.send(r.choice(["xyz", "\r\n", "\x00\xff", "99>"]))
+            self.pump(self.device.now + 0.005)
+
+    def set_low(self):
+        """Holds the set input low for a few ticks and sets the time again, or sends a bad time."""
+        r = self.random
+        down = self.boundary(1) + 0.5 / self.ticks
+        self.pump(down)
+        self.device.set_pin(0)
+        self.sent["set_low"] += 1
+
+        if r.random() < 0.7:
+            # The time the host has, sent exactly at that tick boundary
+            tick = int(self.device.now * self.ticks) + 2
+            self.send("<%s>" % self.tick_text(tick), at=tick / self.ticks)
+            self.sent["time_set"] += 1
+        else:
+            self.send("<%s>" % r.choice(["20251301000000" + "0" * self.digits, "20250631000000" + "0" * self.digits,
+                                         self.tick_text(0)[:8] + "240000" + "0" * self.digits,
+                                         self.tick_text(0) + "|15", self.tick_text(0) + "|2|1e20|25"]))
+            self.expected["invalid"] += 1
+            self.sent["invalid"] += 1
+
+        up = self.boundary(r.randint(3, 10)) + 0.5 / self.ticks
+        self.pump(up)
+        self.device.set_pin(1)
+        self.low.append((down, up))
+
+    # Run
+
+    def stats(self, command):
+        end = self.send_mid_tick("<%s>" % command)
+        line = self.expect_reply(command, "<R|", end)
+        if line is None:
+            return end, None
+        fields = line.text[3:-1].split("|")
+        return end, dict(frames=int(fields[0]), missed=int(fields[1]), latency_min=int(fields[2]),
+                         latency_max=int(fields[3]), histogram=[int(v) for v in fields[4].split(",")],
+                         dropped=int(fields[5]), invalid=int(fields[6]), errors=int(fields[7]))
+
+    def poll(self):
+        """Reads and clears the device counters with <D|1> and adds them to the totals.
+
+        The counters are 16 bit and wrap after 65535 frames, so a long run reads them
+        well before that (see --poll).
+        """
+        end, stats = self.stats("D|1")
+        if stats is None:
+            self.totals = None
+        elif self.totals is not None:
+            totals = self.totals
+            for name in ("frames", "missed", "dropped", "invalid", "errors"):
+                totals[name] += stats[name]
+            totals["histogram"] = [a + b for a, b in zip(totals["histogram"], stats["histogram"])]
+            if stats["frames"]:
+                totals["latency_min"] = min(totals["latency_min"], stats["latency_min"])
+                totals["latency_max"] = max(totals["latency_max"], stats["latency_max"])
+            totals["polls"] += 1
+        return end
+
+    def run(self, seconds, poll=1800.0):
+        device = self.device
+
+        # Set the time while the set input is low, release it in the middle of a tick
+        device.set_pin(0, at=0.0)
+        self.pump(0.2)
+        tick = int(device.now * self.ticks) + 2
+        self.send("<%s>" % self.tick_text(tick), at=tick / self.ticks)
+        self.pump(self.boundary(2) + 0.5 / self.ticks)
+        device.set_pin(1)
+        self.pump(device.now + 0.2)
+
+        start, _ = self.stats("D|1")
+        next_poll = device.now + poll
+        while device.now < seconds:
+            if device.now >= next_poll:
+                self.poll()
+                next_poll += poll
+            elif self.random.random() < 0.04:
+                self.set_low()
+            else:
+                self.one_command()
+            self.pump(device.now + self.random.uniform(0.0, 0.03))
+        self.pump(device.now + 0.1)
+        end = self.poll()
+        self.pump(device.now + 0.1)
+        result = self.check(start, end, self.totals)
+        self.sweep()
+        self.check_sites()
+        return result
+
+    def sweep(self, steps=200):
+        """Queries ending at evenly spaced moments of the tick, for the worst case query latency."""
+        for step in range(steps):
+            query = "Q|" + self.tick_text(0)
+            text = "<%s>" % query
+            phase = step / (steps * self.ticks)
+            end = self.send(text, at=self.boundary(2) + phase - len(text) * self.device.char_time)
+            line = self.expect_reply(query, "<P|", end)
+            if line is not None:
+                self.sweep_latency.append((phase, line.host_start - end, int(line.text[1:-1].split("|")[-1])))
+
+    def check_sites(self):
+        """Queries every site at the time of the last frame, the answers must repeat its positions.
+
+        A frame holds time|azimuth|elevation|latitude|longitude|timezone for site 0 and then
+        azimuth|elevation for each further site.
+        """
+        self.pump(self.device.now + 0.1)
+        frame = [line for line in self.lines if line.text[1:2].isdigit()][-1]
+        fields = frame.text[1:-1].split("|")
+        for site in range(self.sites):
+            query = "Q|%s|%d" % (fields[0], site)
+            line = self.expect_reply(query, "<P|%s|%d|" % (fields[0], site), self.send_mid_tick("<%s>" % query))
+            if line is None:
+                continue
+            expected = fields[1:3] if site == 0 else fields[4 + 2 * site:6 + 2 * site]
+            answer = line.text[1:-1].split("|")[3:5]
+            if answer != expected:
+                self.failures.append("site %d: frame %s, query answer %s" % (site, "|".join(expected), "|".join(answer)))
+
+    def check(self, start, end, stats):
+        device = self.device
+        if stats is None:
+            self.failures.append("no statistics")
+            return None
+
+        frames = [line for line in self.lines if line.text[1:2].isdigit()]
+        overflow_at = {}
+        latencies = []
+        offsets = []
+        for line in frames:
+            index = bisect.bisect_right(self.overflows, line.start_cycle) - 1
+            overflow = self.overflows[index]
+            if not start < device.seconds(overflow) < end:
+                continue
+            overflow_at[index] = line
+            latencies.append(device.seconds(line.end_cycle - overflow))
+            if line.text.count("|") != 5 + 2 * (self.sites - 1):
+                self.failures.append("frame without %d sites: %s" % (self.sites, line.text))
+
+            stamp = datetime.datetime.strptime(line.text[1:15], "%Y%m%d%H%M%S")
+            tick = int((stamp - EPOCH).total_seconds()) * self.ticks + int(line.text[15:15 + self.digits])
+            offsets.append(tick - index)
+
+        # Lost and repeated ticks: the frame time must advance with the overflows
+        lost = repeated = 0
+        for previous, current in zip(offsets, offsets[1:]):
+            lost += max(0, current - previous)
+            repeated += max(0, previous - current)
+
+        # Gaps: ticks with the set input high that sent no frame
+        gaps = []
+        for index, overflow in enumerate(self.overflows):
+            at = device.seconds(overflow)
+            if not start < at < end or any(down <= at <= up for down, up in self.low):
+                continue
+            if index not in overflow_at:
+                gaps.append(at)
+
+        bin_counts = self.info.latency_bin_counts
+        counts = [device.cycles(latency) // 32 for latency in latencies]  # RTC counts, F_CPU / 32
+        histogram = [0] * self.info.latency_bins
+        for count in counts:
+            histogram[min(count // bin_counts, self.info.latency_bins - 1)] += 1
+
+        result = dict(frames=len(latencies), gaps=len(gaps), lost=lost, repeated=repeated, latencies=latencies,
+                      histogram=histogram, stats=stats, tx_lost=device.tx_lost)
+
+        if lost or repeated:
+            self.failures.append("%d lost and %d repeated ticks" % (lost, repeated))
+        if device.tx_lost:
+            self.failures.append("%d characters written to a full transmit buffer" % device.tx_lost)
+        if stats["frames"] != len(latencies):
+            self.failures.append("device counted %d frames, host saw %d" % (stats["frames"], len(latencies)))
+        if stats["missed"] != len(gaps):
+            self.failures.append("device counted %d missed ticks, host saw %d gaps" % (stats["missed"], len(gaps)))
+        for name in ("invalid", "dropped", "errors"):
+            if stats[name] != self.expected[name]:
+                self.failures.append("device counted %d %s, expected %d" % (stats[name], name, self.expected[name]))
+        if sum(stats["histogram"]) != stats["frames"]:
+            self.failures.append("histogram holds %d frames of %d" % (sum(stats["histogram"]), stats["frames"]))
+        if counts and abs(stats["latency_max"] - max(counts)) > 16:
+            self.failures.append("device latency max %d counts, host %d" % (stats["latency_max"], max(counts)))
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--minimal", action="store_true", help="simulate the minimal (ATtiny412) build")
+    parser.add_argument("--seconds", type=float, default=60.0, help="simulated run time")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--sites", type=int, default=1, choices=range(1, len(SITES) + 2),
+                        help="tracker sites of the simulated full build (SOLAR_SITE_COUNT)")
+    parser.add_argument("--poll", type=float, default=1800.0,
+                        help="seconds between <D|1> reads, well below the 54.6 minutes the counters take to wrap")
+    parser.add_argument("--p999-us", type=float, default=600.0, help="limit of the 99.9th percentile frame latency")
+    parser.add_argument("--max-us", type=float, default=1000.0, help="limit of the longest frame latency")
+    args = parser.parse_args()
+
+    if args.minimal and args.sites != 1:
+        parser.error("the minimal build has one site only")
+    soak = Soak(args.minimal, args.seed, args.sites)
+    try:
+        result = soak.run(args.seconds, args.poll)
+    finally:
+        soak.device.close()
+
+    print("sent: %s" % ", ".join("%s %d" % item for item in soak.sent.items()))
+    if result is not None:
+        latencies = [latency * 1e6 for latency in result["latencies"]]
+        p999 = percentile(latencies, 0.999)
+        print("frames %d, gaps %d, lost ticks %d, repeated ticks %d" % (
+            result["frames"], result["gaps"], result["lost"], result["repeated"]))
+        print("frame latency us: min %.1f  p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f" % (
+            min(latencies), percentile(latencies, 0.5), percentile(latencies, 0.99), p999, max(latencies)))
+        print("histogram (%d counts per bin): host %s, device %s" % (
+            soak.info.latency_bin_counts, result["histogram"], result["stats"]["histogram"]))
+        stats = result["stats"]
+        print("device (%d reads): frames %d, missed %d, latency %d..%d counts, invalid %d, dropped %d, errors %d" % (
+            stats["polls"], stats["frames"], stats["missed"], stats["latency_min"], stats["latency_max"],
+            stats["invalid"], stats["dropped"], stats["errors"]))
+        if soak.query_latency:
+            host = [latency * 1e3 for latency, _ in soak.query_latency]
+            counts = [count * 1.6e-3 for _, count in soak.query_latency]
+            print("query latency ms: host p50 %.2f max %.2f, device p50 %.2f max %.2f (%d queries)" % (
+                percentile(host, 0.5), max(host), percentile(counts, 0.5), max(counts), len(host)))
+        if soak.sweep_latency:
+            phase, host, counts = max(soak.sweep_latency, key=lambda sample: sample[1])
+            print("worst query latency over the tick: host %.2f ms, device %.2f ms, query ending %.1f ms into it" % (
+                host * 1e3, counts * 1.6e-3, phase * 1e3))
+        if p999 > args.p999_us:
+            soak.failures.append("p99.9 frame latency %.1f us over %.1f us" % (p999, args.p999_us))
+        if max(latencies) > args.max_us:
+            soak.failures.append("frame latency %.1f us over %.1f us" % (max(latencies), args.max_us))
+
+    for failure in soak.failures:
+        print("FAIL: %s" % failure)
+    print("FAIL" if soak.failures else "ok")
+    return 1 if soak.failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
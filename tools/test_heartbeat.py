@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Simulated test of the heartbeat modes (see README, Heartbeat LED and tick output).
+
+    python3 test_heartbeat.py [--minimal]
+
+Selects each <L|mode> in turn and counts the TCB0 pulses over two seconds:
+
+    0  off                      no pulses
+    1  PPS                      2 pulses of 100 ms, on the overflows that start a second
+    2  tick                     one pulse of half a tick on every overflow
+    3  sync only                no pulses without a sync exchange
+
+and in mode 3 the pulses after <S|...>: one per tick until the one second timeout,
+or until <O|...> ends the exchange earlier. Every pulse must start exactly on an RTC
+overflow, the tick that overflow started is read from the frame it sent.
+
+The exit code is nonzero if a check fails.
+"""
+
+import argparse
+import bisect
+import sys
+
+import avrsim
+
+WINDOW = 2.0
+
+
+class HeartbeatTest:
+    def __init__(self, minimal, seed):
+        self.device = avrsim.Device(minimal=minimal, seed=seed)
+        info = self.device.info
+        self.ticks = info.ticks_per_second
+        self.digits = 2 if self.ticks > 10 else 1
+        self.pulse_tick = (info.f_cpu // 1024) // self.ticks // 2 * 1024
+        self.pulse_second = (info.f_cpu // 1024) // 10 * 1024
+        self.overflows = []
+        self.frames = []
+        self.failures = []
+
+    def run(self, until):
+        device = self.device
+        device.run(until)
+        self.overflows.extend(device.take_overflows())
+        self.frames.extend(line for line in device.take_lines() if line.text[1:2].isdigit())
+
+    def mid_tick(self, ahead=1):
+        """Host time in the middle of a tick, ahead ticks after the current one."""
+        return (int(self.device.now * self.ticks) + ahead + 0.5) / self.ticks
+
+    def command(self, text):
+        """Sends a command so it arrives in the middle of a tick and runs until it was handled."""
+        at = self.mid_tick()
+        self.device.send(text, at=at)
+        self.run(at + 0.1 / self.ticks)
+
+    def pulses(self, seconds):
+        """Runs for seconds from the middle of a tick, returns [(start cycle, length, tick)]."""
+        self.run(self.mid_tick())
+        self.device.take_pulses()
+        self.run(self.device.now + seconds)
+        self.run(self.device.now + 0.5 / self.ticks)
+        result = []
+        for start, length in self.device.take_pulses():
+            result.append((start, length, self.tick_of(start)))
+        return result
+
+    def tick_of(self, cycle):
+        """Tick within the second that the overflow at cycle started, None if it was no overflow.
+
+        The frame sent on an overflow was prepared during the tick before, it carries that tick.
+        """
+        index = bisect.bisect_left(self.overflows, cycle)
+        if index == len(self.overflows) or self.overflows[index] != cycle:
+            return None
+        following = self.overflows[index + 1] if index + 1 < len(self.overflows) else None
+        for line in self.frames:
+            if line.start_cycle >= cycle and (following is None or line.start_cycle < following):
+                return (int(line.text[15:15 + self.digits]) + 1) % self.ticks
+        return -1
+
+    def expect(self, name, pulses, count, length, tick=None):
+        if len(pulses) != count:
+            self.failures.append("%s: %d pulses, expected %d" % (name, len(pulses), count))
+        for start, pulse_length, pulse_tick in pulses:
+            if pulse_tick is None:
+                self.failures.append("%s: pulse at cycle %d is not on an RTC overflow" % (name, start))
+            elif tick is not None and pulse_tick != tick:
+                self.failures.append("%s: pulse on tick %d, expected tick %d" % (name, pulse_tick, tick))
+            if pulse_length != length:
+                self.failures.append("%s: pulse of %d cycles, expected %d" % (name, pulse_length, length))
+        print("%-28s %3d pulses  %s" % (name, len(pulses), "ok" if len(pulses) == count else "FAIL"))
+
+    def test(self):
+        self.run(0.3)
+
+        self.command("<L|0>")
+        self.expect("mode 0 (off)", self.pulses(WINDOW), 0, 0)
+        self.command("<L|1>")
+        self.expect("mode 1 (PPS)", self.pulses(WINDOW), int(WINDOW), self.pulse_second, tick=0)
+        self.command("<L|2>")
+        self.expect("mode 2 (tick)", self.pulses(WINDOW), int(WINDOW * self.ticks), self.pulse_tick)
+        self.command("<L|3>")
+        self.expect("mode 3 (sync only), idle", self.pulses(WINDOW), 0, self.pulse_tick)
+
+        # A sync request without a correction: pulses for one second
+        self.command("<S|1>")
+        self.expect("mode 3, <S|...> only", self.pulses(WINDOW), self.ticks, self.pulse_tick)
+
+        # A correction ends the exchange early. The RTC interrupt arms the pulse for the
+        # following overflow, so the pulses run from the second overflow after <S|...>
+        # to the first overflow after <O|...>.
+        self.run(self.mid_tick())
+        self.device.take_pulses()
+        self.command("<S|2>")
+        sync_start = len(self.overflows)
+        self.run(self.device.now + 4.0 / self.ticks)
+        self.command("<O|0>")
+        sync_end = len(self.overflows)
+        self.run(self.device.now + WINDOW)
+        pulses = [(start, length, self.tick_of(start)) for start, length in self.device.take_pulses()]
+        self.expect("mode 3, <S|...> then <O|0>", pulses, sync_end - sync_start, self.pulse_tick)
+        if pulses and (pulses[0][0] != self.overflows[sync_start + 1] or pulses[-1][0] != self.overflows[sync_end]):
+            self.failures.append("mode 3: pulses not from the second overflow after <S|...> to the first after <O|...>")
+
+    def close(self):
+        self.device.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--minimal", action="store_true", help="simulate the minimal (ATtiny412) build")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    test = HeartbeatTest(args.minimal, args.seed)
+    try:
+        test.test()
+    finally:
+        test.close()
+    for failure in test.failures:
+        print("FAIL: %s" % failure)
+    return 1 if test.failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Simulated-link test of the time sync: sets the clock, syncs it with timesync.py and
+reports the residual offset between the device clock and the host clock.
+
+    python3 test_timesync.py [--minimal]
+
+The NTP-style exchange cannot see link asymmetry, so after a sync the device is off by
+(down - up) / 2. Each scenario checks the residual against that within the device
+resolution (1.6 us counts, interrupt latency) plus half the link jitter.
+"""
+
+import argparse
+import sys
+
+import avrsim
+import timesync
+
+# name, up delay, down delay, jitter (seconds), drift (ppm), host time of day at start
+SCENARIOS = [
+    ("direct", 0.0, 0.0, 0.0, 0.0, 43200.0),
+    ("symmetric 250 us", 250e-6, 250e-6, 0.0, 0.0, 43200.0),
+    ("jitter 200 us", 250e-6, 250e-6, 200e-6, 0.0, 43200.0),
+    ("asymmetric 400/100 us", 400e-6, 100e-6, 0.0, 0.0, 43200.0),
+    ("drift +50 ppm", 250e-6, 250e-6, 50e-6, 50.0, 43200.0),
+    ("across midnight", 250e-6, 250e-6, 50e-6, -20.0, 86399.3),
+]
+
+TOLERANCE = 4e-6
+
+
+def time_set_command(tod, ticks, digits):
+    """<YYYYMMDDhhmmsstt> for a time of day that is a whole number of ticks."""
+    total = int(round(tod * ticks)) % int(86400 * ticks)
+    seconds, tick = divmod(total, ticks)
+    return "<20250621%02d%02d%02d%0*d>" % (seconds // 3600, seconds // 60 % 60, seconds % 60, digits, tick)
+
+
+def run(name, up, down, jitter, drift, tod0, minimal, seed):
+    device = avrsim.Device(minimal=minimal, drift_ppm=drift, up_delay=up, down_delay=down, jitter=jitter, seed=seed)
+    link = avrsim.SimLink(device, tod0)
+    ticks = device.info.ticks_per_second
+    try:
+        # Time set: clock set input low, command sent exactly on a host tick boundary
+        device.set_pin(0, at=0.0)
+        device.run(0.3)
+        send_tod = (int(link.now() * ticks) + 2) / ticks
+        sent = device.send(time_set_command(send_tod, ticks, 2 if ticks > 10 else 1),
+                           at=device.now + timesync.wrap(send_tod - link.now()))
+        device.run(sent + 0.05)
+        device.set_pin(1)
+        device.run_for(0.3)
+        device.take_lines()
+        coarse = timesync.wrap(device.time_of_day() - link.now())
+
+        best, taken, micros = timesync.sync(link, samples=8)
+        device.run_for(0.05)
+        residual = timesync.wrap(device.time_of_day() - link.now())
+    finally:
+        device.close()
+
+    expected = (down - up) / 2
+    passed = abs(residual - expected) <= TOLERANCE + jitter / 2
+    return dict(name=name, coarse=coarse, theta=best.theta, delta=best.delta, correction=micros,
+                residual=residual, expected=expected, passed=passed)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--minimal", action="store_true", help="simulate the minimal (ATtiny412) build")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    print("%-22s %12s %12s %10s %12s %12s" % ("scenario", "after set", "theta", "delta", "residual", "expected"))
+    failed = 0
+    for scenario in SCENARIOS:
+        r = run(*scenario, minimal=args.minimal, seed=args.seed)
+        failed += not r["passed"]
+        print("%-22s %+10.1fus %+10.1fus %8.1fus %+10.1fus %+10.1fus  %s" % (
+            r["name"], r["coarse"] * 1e6, r["theta"] * 1e6, r["delta"] * 1e6, r["residual"] * 1e6,
+            r["expected"] * 1e6, "ok" if r["passed"] else "FAIL"))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
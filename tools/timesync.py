@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Reference host client for the clock's two-step time sync (see README, Time sync).
+
+    python3 timesync.py /dev/ttyUSB0 [--samples 8] [--utc-offset HOURS]
+
+Sends <S|T1> a number of times, takes the exchange with the smallest round trip
+delta, and sends the correction <O|-theta>. T1 and T4 are the host local time of day
+in the clock's timezone, T2 and T3 come from the device:
+
+    theta = ((T2 - T1) + (T3 - T4)) / 2      device clock minus host clock
+    delta = (T4 - T1) - (T3 - T2)            round trip on the link
+
+The serial transport needs pyserial. It takes T4 when the first byte of the answer
+is read, so USB latency ends up in delta and, if it is not symmetric, in theta.
+"""
+
+import argparse
+import sys
+import time
+
+DAY = 86400.0
+
+
+def format_time(seconds):
+    """Time of day as SSSSS.UUUUUU, like the device sends it."""
+    micros = int(round(seconds * 1e6)) % int(DAY * 1e6)
+    return "%05d.%06d" % (micros // 1000000, micros % 1000000)
+
+
+def wrap(seconds):
+    """Brings a time difference into -12 h .. 12 h, for exchanges across midnight."""
+    return (seconds + DAY / 2) % DAY - DAY / 2
+
+
+class Sample:
+    def __init__(self, t1, t2, t3, t4):
+        self.t1, self.t2, self.t3, self.t4 = t1, t2, t3, t4
+        self.theta = (wrap(t2 - t1) + wrap(t3 - t4)) / 2
+        self.delta = wrap(t4 - t1) - wrap(t3 - t2)
+
+
+def exchange(link, timeout=1.0):
+    """One <S|T1> / <T|T1|T2|T3> exchange, returns a Sample or None on timeout."""
+    t1 = link.now()
+    stamp = format_time(t1)
+    link.write("<S|%s>" % stamp)
+    prefix = "<T|%s|" % stamp
+    while True:
+        text, t4 = link.read_line(timeout)
+        if text is None:
+            return None
+        if text.startswith(prefix) and text.endswith(">"):
+            fields = text[1:-1].split("|")
+            return Sample(t1, float(fields[2]), float(fields[3]), t4)
+
+
+def correct(link, theta, timeout=1.0):
+    """Sends <O|-theta> and waits for <A|...>. Returns the applied correction in microseconds."""
+    micros = -int(round(theta * 1e6))
+    if abs(micros) > 1000000:
+        raise ValueError("offset %.6f s is over one second, set the time first" % theta)
+    link.write("<O|%d>" % micros)
+    while True:
+        text, _ = link.read_line(timeout)
+        if text is None:
+            raise TimeoutError("no answer to the correction")
+        if text == "<A|%d>" % micros:
+            return micros
+
+
+def sync(link, samples=8, timeout=1.0):
+    """Measures the offset samples times and corrects the device with the best sample.
+
+    Returns (best sample, all samples, applied correction in microseconds).
+    """
+    taken = [s for s in (exchange(link, timeout) for _ in range(samples)) if s is not None]
+    if not taken:
+        raise TimeoutError("no answer to the sync requests")
+    best = min(taken, key=lambda s: s.delta)
+    return best, taken, correct(link, best.theta, timeout)
+
+
+class SerialLink:
+    """Serial port transport. Host time is the system clock shifted by utc_offset hours."""
+
+    def __init__(self, port, baud=2500000, utc_offset=None):
+        import serial  # pyserial
+
+        self.port = serial.Serial(port, baud, timeout=0)
+        if utc_offset is None:
+            utc_offset = -(time.altzone if time.localtime().tm_isdst > 0 else time.timezone) / 3600.0
+        self.offset = utc_offset * 3600.0
+        self.buffer = bytearray()
+        self.started = None
+
+    def now(self):
+        return (time.time() + self.offset) % DAY
+
+    def write(self, text):
+        self.port.write(text.encode("ascii"))
+        self.port.flush()
+
+    def read_line(self, timeout=1.0):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            data = self.port.read(1)
+            if not data:
+                continue
+            if data == b"<":
+                self.buffer = bytearray()
+                self.started = self.now()
+            self.buffer += data
+            if data == b"\n" and self.started is not None:
+                started, self.started = self.started, None
+                return self.buffer.decode("latin-1").rstrip("\r\n"), started
+        return None, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=2500000)
+    parser.add_argument("--samples", type=int, default=8)
+    parser.add_argument("--utc-offset", type=float, default=None,
+                        help="hours from UTC of the clock's local time (default: this computer's)")
+    args = parser.parse_args()
+
+    link = SerialLink(args.port, args.baud, args.utc_offset)
+    best, taken, micros = sync(link, args.samples)
+    for s in taken:
+        print("theta %+12.6f s  delta %10.6f s%s" % (s.theta, s.delta, "  <-" if s is best else ""))
+    print("corrected by %+d us" % micros)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())